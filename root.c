@@ -1,6 +1,3 @@
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -9,76 +6,71 @@
 #include "rte_buddy.h"
 #include "rte_slub.h"
 #include "rte_mem.h"
+#include "rte_pool.h"
 
 #define HUGE_PAGE_DIR  "/dev/hugepages"
-#define HUGE_PAGE_FILE "%s/.rte_maps_file"
-#define HUGE_PAGE_SIZE 0x200000
+#define HUGE_PAGE_SHIFT 21
+#define HUGE_PAGE_NUM 1
 #define RTE_SHM_FIXED_ADDR 0x100000000UL
 
-/*
- * 内存控制结构
- * */
-struct mem_cb{
-	struct rte_mem_zone zone;
-	struct rte_mem_cache mem_cache[RTE_SHM_CACHE_NUM];
-	struct rte_page page[0];
+/* 应用保存在持久内存池中的根对象 */
+struct app_root{
+	uint64_t run_count;
+	void *obj;
 };
 
-static struct mem_cb *global_mem_cb=NULL;
-static int mem_block_init(void)
+/*
+ * 持久模式: 内存池文件不截断，进程重启后重新使用上一次的堆，
+ * 根对象记录了进程运行的次数
+ * */
+static int mem_pool_persist(struct rte_mem_config *cfg)
 {
-	char filename[128];
-	int fd=0;
-	void *virtaddr=NULL;
-	int ret=0;
-	int mem_cb_len=0;
-
-	mem_cb_len = sizeof(struct mem_cb) + 512*sizeof(struct rte_page);
-	printf("mem_cb_len = %d\n", mem_cb_len);
-
-	global_mem_cb = (struct mem_cb *)malloc(mem_cb_len);
-	if(NULL==global_mem_cb){
-		return -1;
-	}
-
-	// 分配一个hugepage内存, 作为总的内存池
-	memset(filename, 0, 128);	
-	sprintf(filename, HUGE_PAGE_FILE, HUGE_PAGE_DIR);
-	fd = open(filename, O_CREAT|O_RDWR|O_TRUNC, 0777); //在hugetlbfs所挂载的目录中新建一个文件，即分配了一块大页内存
-	if(fd<0){
-		return -1;
-	}
-
-	virtaddr = mmap((void *)RTE_SHM_FIXED_ADDR, HUGE_PAGE_SIZE, (PROT_READ|PROT_WRITE), (MAP_FIXED|MAP_SHARED), fd, 0); //将大页影射到用户空间
-	if(virtaddr==MAP_FAILED){
-		perror("mmap");
-		close(fd);
-		return -1;
-	}
-	memset(virtaddr, 0, 0x200000); //每个大页2MB
-	close(fd); // 进行了mmap影射后，可以关闭文件
+	struct app_root *root;
+	int ret;
 
-	/* 一个大页(2MB)分为512小页，每个小页4KB,交给Buddy系统管理 */
-	ret = rte_buddy_system_init(&global_mem_cb->zone, (unsigned long)virtaddr,global_mem_cb->page, 512);
+	cfg->persistent = 1;
+	ret = rte_mem_init(cfg);
 	if(ret<0){
-		goto out;
+		printf("Failed to open the persistent memory pool.\n");
+		return -1;
 	}
 
-	ret = rte_slub_system_init(global_mem_cb->mem_cache, RTE_SHM_CACHE_NUM);
-	if(ret<0){
-		goto out;
+	root = rte_pool_get_root(0);
+	if(ret==RTE_POOL_NEW||NULL==root){
+		root = rte_malloc(sizeof(struct app_root));
+		if(NULL==root){
+			rte_mem_exit();
+			return -1;
+		}
+		memset(root, 0, sizeof(struct app_root));
+		root->obj = rte_malloc(1000);
+		rte_pool_set_root(0, root);
 	}
+	root->run_count++;
+	printf("%s pool, run %lu, root object %p\n", ret==RTE_POOL_ATTACHED ? "attached" : "new",
+			root->run_count, root->obj);
 
-out:
-	return 0;	
+	rte_mem_exit();
+	return 0;
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
 	int ret=0;	
 	void *ptr=NULL;
+	struct rte_mem_config cfg = {
+		.backend = RTE_MEM_HUGETLBFS, // 没有大页的机器上可使用RTE_MEM_4K
+		.size = (size_t)HUGE_PAGE_NUM<<HUGE_PAGE_SHIFT,
+		.huge_shift = HUGE_PAGE_SHIFT,
+		.hugetlbfs_dir = HUGE_PAGE_DIR,
+		.addr = RTE_SHM_FIXED_ADDR,
+		.prefault = RTE_PREFAULT_POPULATE,
+	};
 
-	ret = mem_block_init();
+	if(argc>1 && !strcmp(argv[1], "persist")){
+		return mem_pool_persist(&cfg);
+	}
+	ret = rte_mem_init(&cfg);
 	if(ret<0){
 		return -1;
 	}
@@ -89,6 +81,7 @@ int main(void)
 	printf("ptr = %p\n", ptr);	
 
 	rte_free(ptr);
+	rte_mem_exit();
 
 	return 0;
 }
@@ -0,0 +1,1347 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rte_buddy.h"
+#include "rte_slub.h"
+#include "rte_mem.h"
+#include "rte_rcu.h"
+#include "rte_cycles.h"
+#include "rte_trace.h"
+#include "rte_mempool.h"
+#include "rte_tag.h"
+#include "rte_uring.h"
+
+/*
+ * 性能测试程序。内存池使用普通内存(不需要hugepage)，
+ * 每个测试项以一个子命令的形式给出，-t把运行中的分配事件记录到文件中(见rte_replay):
+ * 	./rte_bench lock [-c cores] [-n iterations] [-t trace]
+ * 	./rte_bench churn [-n iterations]
+ * 	./rte_bench rcu [-c cores] [-n iterations]
+ * 	./rte_bench latency [-c cores] [-n iterations] (需要以-DRTE_SLUB_LATENCY编译)
+ * 	./rte_bench mempool [-c cores] [-n iterations]
+ * 	./rte_bench frag [-n iterations] (以-DRTE_BUDDY_NO_GROUPING编译可对比不分组的情况)
+ * 	./rte_bench defrag
+ * 	./rte_bench tenant
+ * 	./rte_bench bitmap [-c cores] [-n iterations]
+ * 	./rte_bench bulk [-c cores] [-n iterations]
+ * 	./rte_bench color [-n iterations]
+ * 	./rte_bench warmup [-c cores]
+ * 	./rte_bench uring [-n iterations] (在当前目录下创建临时文件)
+ * */
+
+#define BENCH_POOL_PAGES 8192
+
+struct bench_cb{
+	struct rte_mem_zone zone;
+	struct rte_mem_cache mem_cache[RTE_SHM_CACHE_NUM];
+	struct rte_page page[0];
+};
+
+static struct bench_cb *bench_cb;
+static int bench_cores = RTE_MAX_CPU_NUM;
+static int bench_iters = 100000;
+
+static void bench_pool_exit(void)
+{
+	if(NULL==bench_cb){
+		return;
+	}
+	free((void *)bench_cb->zone.start_addr);
+	free(bench_cb);
+	bench_cb = NULL;
+}
+
+/* 可以多次调用，每次都释放原来的内存池并新建一个 */
+static int bench_pool_init(unsigned int page_num)
+{
+	void *addr=NULL;
+
+	bench_pool_exit();
+	bench_cb = malloc(sizeof(struct bench_cb) + page_num*sizeof(struct rte_page));
+	if(NULL==bench_cb){
+		return -1;
+	}
+	if(posix_memalign(&addr, RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1), (size_t)page_num*RTE_PAGE_SIZE)){
+		free(bench_cb);
+		bench_cb = NULL;
+		return -1;
+	}
+	memset(addr, 0, (size_t)page_num*RTE_PAGE_SIZE);
+	bench_cb->zone.start_addr = (unsigned long)addr;
+	if(rte_buddy_system_init(&bench_cb->zone, (unsigned long)addr, bench_cb->page, page_num)<0){
+		bench_pool_exit();
+		return -1;
+	}
+	return rte_slub_system_init(bench_cb->mem_cache, RTE_SHM_CACHE_NUM);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static inline uint32_t bench_rand(uint32_t *x)
+{
+	*x ^= *x<<13;
+	*x ^= *x>>17;
+	*x ^= *x<<5;
+	return *x;
+}
+
+static void bench_bind_core(int id)
+{
+	cpu_set_t set;
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	CPU_ZERO(&set);
+	CPU_SET(id%(n>0?n:1), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x>y)-(x<y);
+}
+
+/*
+ * 多线程测试框架: 每个线程以自己的序号作为Core序号，
+ * 执行fn并把每次操作的耗时(TSC周期)记录到lat中。
+ * 失败的操作不计时，fn把成功操作的耗时依次放在lat的前面，并把失败的次数记到failed中
+ * */
+struct bench_thread{
+	pthread_t tid;
+	int id;
+	int iters;
+	int failed;
+	uint64_t *lat;
+	double start, end;
+	void (*fn)(struct bench_thread *t);
+};
+
+static pthread_barrier_t bench_barrier;
+
+static void *bench_thread_main(void *arg)
+{
+	struct bench_thread *t = arg;
+
+	bench_bind_core(t->id);
+	rte_set_self_id(t->id);
+	pthread_barrier_wait(&bench_barrier);
+	t->start = bench_now();
+	t->fn(t);
+	t->end = bench_now();
+	return NULL;
+}
+
+static void bench_run(const char *name, int cores, void (*fn)(struct bench_thread *t))
+{
+	struct bench_thread th[RTE_MAX_CPU_NUM];
+	uint64_t *all;
+	double start=0, end=0, elapsed;
+	long total = (long)cores*bench_iters;
+	long failed=0;
+	int i;
+
+	all = malloc(total*sizeof(uint64_t));
+	if(NULL==all){
+		return;
+	}
+	pthread_barrier_init(&bench_barrier, NULL, cores+1);
+	for(i=0;i<cores;i++){
+		th[i].id = i;
+		th[i].iters = bench_iters;
+		th[i].failed = 0;
+		th[i].lat = all + (long)i*bench_iters;
+		th[i].fn = fn;
+		pthread_create(&th[i].tid, NULL, bench_thread_main, &th[i]);
+	}
+	pthread_barrier_wait(&bench_barrier);
+	for(i=0;i<cores;i++){
+		pthread_join(th[i].tid, NULL);
+		if(i==0||th[i].start<start)
+			start = th[i].start;
+		if(th[i].end>end)
+			end = th[i].end;
+	}
+	elapsed = end - start;
+	pthread_barrier_destroy(&bench_barrier);
+
+	total = 0;
+	for(i=0;i<cores;i++){
+		memmove(all+total, th[i].lat, (th[i].iters-th[i].failed)*sizeof(uint64_t));
+		total += th[i].iters - th[i].failed;
+		failed += th[i].failed;
+	}
+	if(failed){
+		printf("%-15s cores=%d  %ld operations failed\n", name, cores, failed);
+	}
+	if(!total){
+		free(all);
+		return;
+	}
+	qsort(all, total, sizeof(uint64_t), cmp_u64);
+	printf("%-15s cores=%d  %10.0f ops/s  p50=%lu p99=%lu p999=%lu max=%lu cycles\n",
+			name, cores, total/elapsed, all[total/2], all[total*99/100],
+			all[total*999/1000], all[total-1]);
+	free(all);
+}
+
+/* Buddy路径: 每次分配并释放一个页, 竞争zone->lock */
+static void bench_buddy_fn(struct bench_thread *t)
+{
+	struct rte_page *page;
+	uint64_t t0;
+	int i;
+
+	for(i=0;i<t->iters;i+=2){
+		t0 = rte_rdtsc();
+		page = rte_get_pages(0);
+		t->lat[i] = rte_rdtsc() - t0;
+		t0 = rte_rdtsc();
+		if(page){
+			rte_free_pages(page);
+		}
+		if(i+1<t->iters){
+			t->lat[i+1] = rte_rdtsc() - t0;
+		}
+	}
+}
+
+/*
+ * Partial链表路径: 每轮分配一批对象后全部释放,
+ * 释放的对象所在的页进入partial链表，下一轮再从partial链表取回,
+ * 竞争mem_cache_node.list_lock
+ * */
+#define BENCH_BATCH 64
+#define BENCH_OBJ_SIZE 512
+static void bench_partial_fn(struct bench_thread *t)
+{
+	void *obj[BENCH_BATCH];
+	uint64_t t0;
+	int i=0, j;
+
+	while(i<t->iters){
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			obj[j] = rte_malloc(BENCH_OBJ_SIZE);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			rte_free(obj[j]);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+	}
+}
+
+static int bench_lock(void)
+{
+	int cores;
+
+	for(cores=1;cores<=bench_cores;cores++){
+		bench_run("buddy", cores, bench_buddy_fn);
+	}
+	for(cores=1;cores<=bench_cores;cores++){
+		bench_run("partial", cores, bench_partial_fn);
+	}
+	return 0;
+}
+
+static unsigned int bench_free_pages(void)
+{
+	struct rte_mem_zone *zone = &bench_cb->zone;
+	unsigned int i, nr=0;
+
+	for(i=0;i<zone->arena_num;i++){
+		nr += zone->arena[i].free_zero_num;
+	}
+	return nr;
+}
+
+/*
+ * 延迟释放: 各Core随机读取共享数组中的对象，或用新对象替换并以rte_free_deferred()释放旧对象。
+ * 读者持有读到的对象直到下一次静止状态或替换操作之前，并检查对象中的key，
+ * 宽限期未结束就被释放的对象重新分配后key会改变
+ * */
+#define BENCH_RCU_SLOTS 1024
+#define BENCH_RCU_QS 16 // 每隔多少次操作报告一次静止状态
+#define BENCH_RCU_SIZE 64
+static uint64_t *bench_rcu_slot[BENCH_RCU_SLOTS];
+static uint64_t bench_rcu_errors;
+
+static void bench_rcu_check(uint64_t *held, uint64_t key)
+{
+	if(held && *(volatile uint64_t *)held!=key){
+		__atomic_fetch_add(&bench_rcu_errors, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void bench_rcu_fn(struct bench_thread *t)
+{
+	uint32_t seed = t->id + 1;
+	uint64_t *obj, *held=NULL, key=0, t0;
+	unsigned int j;
+	int i, n=0;
+
+	rte_rcu_register_thread();
+	for(i=0;i<t->iters;i++){
+		j = bench_rand(&seed)%BENCH_RCU_SLOTS;
+		t0 = rte_rdtsc();
+		if(bench_rand(&seed)%4){
+			bench_rcu_check(held, key);
+			held = __atomic_load_n(&bench_rcu_slot[j], __ATOMIC_ACQUIRE);
+			key = j;
+		}else{
+			bench_rcu_check(held, key); // rte_free_deferred()可能报告静止状态
+			held = NULL;
+			obj = rte_malloc(BENCH_RCU_SIZE);
+			if(NULL==obj){
+				t->failed++;
+				continue;
+			}
+			*obj = j;
+			rte_free_deferred(__atomic_exchange_n(&bench_rcu_slot[j], obj, __ATOMIC_ACQ_REL));
+		}
+		t->lat[n++] = rte_rdtsc() - t0;
+		if(i%BENCH_RCU_QS==BENCH_RCU_QS-1){
+			bench_rcu_check(held, key);
+			held = NULL;
+			rte_rcu_quiescent();
+		}
+	}
+	bench_rcu_check(held, key);
+	rte_rcu_flush();
+	rte_rcu_unregister_thread();
+}
+
+static int bench_rcu(void)
+{
+	unsigned int i;
+
+	for(i=0;i<BENCH_RCU_SLOTS;i++){
+		bench_rcu_slot[i] = rte_malloc(BENCH_RCU_SIZE);
+		if(NULL==bench_rcu_slot[i]){
+			return -1;
+		}
+		*bench_rcu_slot[i] = i;
+	}
+	bench_run("rcu", bench_cores, bench_rcu_fn);
+	for(i=0;i<BENCH_RCU_SLOTS;i++){
+		rte_free(bench_rcu_slot[i]);
+	}
+	printf("stale reads: %lu\n", bench_rcu_errors);
+	return bench_rcu_errors ? -1 : 0;
+}
+
+/*
+ * 长时间随机分配/释放后，统计Slab占用的页数与实际使用的字节数，
+ * 衡量partial链表策略对碎片的影响
+ * */
+#define BENCH_CHURN_LIVE 8192
+static int bench_churn(void)
+{
+	static void *obj[BENCH_CHURN_LIVE];
+	static int len[BENCH_CHURN_LIVE];
+	unsigned long live=0, pages;
+	int i, j, round;
+
+	srand(1);
+	rte_set_self_id(0);
+	for(round=0; round<=bench_iters/BENCH_CHURN_LIVE; round++){
+		for(i=0;i<BENCH_CHURN_LIVE;i++){
+			j = rand()%BENCH_CHURN_LIVE;
+			if(obj[j]){
+				rte_free(obj[j]);
+				live -= len[j];
+				obj[j] = NULL;
+			}
+			/* 工作集先增长后收缩，留下稀疏的slab */
+			if(round<2||rand()%4==0){
+				len[j] = 32 + rand()%480;
+				obj[j] = rte_malloc(len[j]);
+				if(obj[j]){
+					live += len[j];
+				}
+			}
+		}
+		pages = BENCH_POOL_PAGES - bench_free_pages();
+		printf("round %3d: live=%8lu bytes  slab pages=%5lu  utilization=%5.1f%%\n",
+				round, live, pages, pages ? 100.0*live/(pages*RTE_PAGE_SIZE) : 0);
+	}
+	return 0;
+}
+
+/*
+ * 各线程随机分配/释放不同大小的Obj，之后按cache与路径输出合并后的延迟分布，
+ * 用于判断尾延迟来自哪条路径
+ * */
+#define BENCH_LAT_LIVE 1024
+static void bench_latency_fn(struct bench_thread *t)
+{
+	void *obj[BENCH_LAT_LIVE] = {NULL};
+	unsigned int seed = t->id + 1;
+	uint64_t t0;
+	int i, j;
+
+	for(i=0;i<t->iters;i++){
+		j = rand_r(&seed)%BENCH_LAT_LIVE;
+		t0 = rte_rdtsc();
+		if(obj[j]){
+			rte_free(obj[j]);
+			obj[j] = NULL;
+		}else{
+			obj[j] = rte_malloc(32 + rand_r(&seed)%4064);
+		}
+		t->lat[i] = rte_rdtsc() - t0;
+	}
+	for(j=0;j<BENCH_LAT_LIVE;j++){
+		rte_free(obj[j]);
+	}
+}
+
+static int bench_latency(void)
+{
+	static const char *path_name[RTE_LAT_PATH_NUM] = {
+		"fast", "partial", "new_slab", "buddy_split", "remote_free"
+	};
+	struct rte_lat_hist hist;
+	struct rte_mem_cache *s;
+	int i, path, cache_num;
+	uint64_t total;
+
+	bench_run("latency", bench_cores, bench_latency_fn);
+	s = rte_slub_caches(&cache_num);
+	printf("%8s %-12s %10s %8s %8s %8s %8s (cycles)\n", "size", "path",
+			"count", "p50", "p99", "p999", "max");
+	for(i=0;i<cache_num;i++){
+		for(path=0;path<RTE_LAT_PATH_NUM;path++){
+			if(rte_slub_latency(s+i, path, &hist)<0){
+				printf("Build with -DRTE_SLUB_LATENCY to record latency histograms.\n");
+				return -1;
+			}
+			total = rte_lat_total(&hist);
+			if(!total){
+				continue;
+			}
+			printf("%8d %-12s %10lu %8lu %8lu %8lu %8lu\n", s[i].size, path_name[path], total,
+					rte_lat_percentile(&hist, 500), rte_lat_percentile(&hist, 990),
+					rte_lat_percentile(&hist, 999), rte_lat_percentile(&hist, 1000));
+		}
+	}
+	return 0;
+}
+
+/*
+ * 对象池与Slub的比较: 每个线程成批地取出BENCH_BATCH个包缓冲区再全部放回，
+ * 每次操作的耗时分别记录
+ * */
+#define BENCH_MP_ELT_SIZE 2048
+#define BENCH_MP_ELTS 4096
+#define BENCH_MP_CACHE 256
+static struct rte_mempool *bench_mp;
+
+static void bench_mempool_fn(struct bench_thread *t)
+{
+	void *obj[BENCH_BATCH];
+	uint64_t t0;
+	int i=0, j;
+
+	while(i<t->iters){
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			obj[j] = rte_mempool_get(bench_mp);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			if(obj[j]){
+				rte_mempool_put(bench_mp, obj[j]);
+			}
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+	}
+}
+
+/* 每次操作为一次BENCH_BATCH个元素的bulk取出或放回 */
+static void bench_mempool_bulk_fn(struct bench_thread *t)
+{
+	void *obj[BENCH_BATCH];
+	uint64_t t0;
+	int i=0, ret;
+
+	while(i<t->iters){
+		t0 = rte_rdtsc();
+		ret = rte_mempool_get_bulk(bench_mp, obj, BENCH_BATCH);
+		t->lat[i++] = rte_rdtsc() - t0;
+		t0 = rte_rdtsc();
+		if(!ret){
+			rte_mempool_put_bulk(bench_mp, obj, BENCH_BATCH);
+		}
+		if(i<t->iters){
+			t->lat[i++] = rte_rdtsc() - t0;
+		}
+	}
+}
+
+static void bench_slab_fn(struct bench_thread *t)
+{
+	void *obj[BENCH_BATCH];
+	uint64_t t0;
+	int i=0, j;
+
+	while(i<t->iters){
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			obj[j] = rte_malloc(BENCH_MP_ELT_SIZE);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+		for(j=0;j<BENCH_BATCH;j++){
+			t0 = rte_rdtsc();
+			rte_free(obj[j]);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+	}
+}
+
+static int bench_mempool(void)
+{
+	int cores;
+
+	bench_mp = rte_mempool_create(BENCH_MP_ELTS, BENCH_MP_ELT_SIZE, BENCH_MP_CACHE);
+	if(NULL==bench_mp){
+		printf("Failed to create mempool.\n");
+		return -1;
+	}
+	for(cores=1;cores<=bench_cores;cores++){
+		bench_run("slab", cores, bench_slab_fn);
+		bench_run("mempool", cores, bench_mempool_fn);
+		bench_run("mp_bulk", cores, bench_mempool_bulk_fn);
+	}
+	rte_mempool_free(bench_mp);
+	return 0;
+}
+
+/*
+ * 长期存活的Slab对象与短期的多阶页分配交替进行，模拟长时间运行的进程，
+ * 每轮结束后统计还能分配多少个BENCH_FRAG_ORDER阶的块
+ * */
+#define BENCH_FRAG_OBJS 16384
+#define BENCH_FRAG_PAGES 256
+#define BENCH_FRAG_ORDER (RTE_MAX_ORDER-2)
+static int bench_frag(void)
+{
+	static void *obj[BENCH_FRAG_OBJS];
+	static struct rte_page *pages[BENCH_FRAG_PAGES];
+	static struct rte_page *high[BENCH_POOL_PAGES>>BENCH_FRAG_ORDER];
+	struct rte_mem_zone *zone = &bench_cb->zone;
+	uint64_t steal, fallback;
+	unsigned int nr_high;
+	int i, j, round;
+
+	srand(1);
+	rte_set_self_id(0);
+	for(round=0; round<=bench_iters/BENCH_FRAG_OBJS; round++){
+		for(i=0;i<BENCH_FRAG_OBJS;i++){
+			j = rand()%BENCH_FRAG_OBJS;
+			if(obj[j]&&rand()%2){
+				rte_free(obj[j]);
+				obj[j] = NULL;
+			}
+			if(NULL==obj[j]){
+				obj[j] = rte_malloc(64 + rand()%960);
+			}
+			j = rand()%BENCH_FRAG_PAGES;
+			if(pages[j]){
+				rte_free_pages(pages[j]);
+			}
+			pages[j] = rte_get_pages(rand()%4);
+		}
+		for(j=0;j<BENCH_FRAG_PAGES;j++){
+			if(pages[j]){
+				rte_free_pages(pages[j]);
+				pages[j] = NULL;
+			}
+		}
+
+		for(nr_high=0; nr_high<sizeof(high)/sizeof(high[0]); nr_high++){
+			high[nr_high] = rte_get_pages(BENCH_FRAG_ORDER);
+			if(NULL==high[nr_high]){
+				break;
+			}
+		}
+		for(j=0;j<nr_high;j++){
+			rte_free_pages(high[j]);
+		}
+		steal = fallback = 0;
+		for(j=0;j<zone->arena_num;j++){
+			steal += zone->arena[j].nr_block_steal;
+			fallback += zone->arena[j].nr_fallback;
+		}
+		printf("round %3d: free pages=%5u  order-%u allocs=%4u (%5.1f%% of free)  steal=%lu fallback=%lu\n",
+				round, bench_free_pages(), BENCH_FRAG_ORDER, nr_high,
+				bench_free_pages() ? 100.0*(nr_high<<BENCH_FRAG_ORDER)/bench_free_pages() : 0,
+				steal, fallback);
+	}
+	for(j=0;j<BENCH_FRAG_OBJS;j++){
+		if(obj[j]){
+			rte_free(obj[j]);
+		}
+	}
+	return 0;
+}
+
+/*
+ * 通过句柄表访问的Obj可以被移动: Obj的前4个字节保存自己的句柄，
+ * 句柄表中的指针指向该Obj时才允许迁移
+ * */
+#define BENCH_DEFRAG_OBJS 16384
+#define BENCH_DEFRAG_SIZE 256
+static void *bench_handle[BENCH_DEFRAG_OBJS];
+
+static int bench_isolate(void *obj, void *arg)
+{
+	uint32_t h = *(uint32_t *)obj;
+
+	return !(h<BENCH_DEFRAG_OBJS && bench_handle[h]==obj);
+}
+
+static void bench_migrate(void *from, void *to, uint32_t size, void *arg)
+{
+	memcpy(to, from, BENCH_DEFRAG_SIZE);
+	bench_handle[*(uint32_t *)to] = to;
+}
+
+static void bench_putback(void *obj, void *arg)
+{
+}
+
+static const struct rte_slub_mobility bench_mobility = {
+	.isolate = bench_isolate,
+	.migrate = bench_migrate,
+	.putback = bench_putback,
+};
+
+static void bench_defrag_report(const char *name, unsigned long live)
+{
+	unsigned long pages = BENCH_POOL_PAGES - bench_free_pages();
+
+	printf("%-8s live=%8lu bytes  slab pages=%5lu  utilization=%5.1f%%\n",
+			name, live, pages, pages ? 100.0*live/(pages*RTE_PAGE_SIZE) : 0);
+}
+
+static int bench_defrag(void)
+{
+	unsigned long live=0;
+	uint32_t i;
+	double t0;
+	int nr;
+
+	srand(1);
+	rte_set_self_id(0);
+	rte_slub_set_mobility(BENCH_DEFRAG_SIZE, &bench_mobility);
+	for(i=0;i<BENCH_DEFRAG_OBJS;i++){
+		bench_handle[i] = rte_malloc(BENCH_DEFRAG_SIZE);
+		if(bench_handle[i]){
+			*(uint32_t *)bench_handle[i] = i;
+			live += BENCH_DEFRAG_SIZE;
+		}
+	}
+	bench_defrag_report("full", live);
+	for(i=0;i<BENCH_DEFRAG_OBJS;i++){ // 随机释放90%的Obj，留下稀疏的slab
+		if(bench_handle[i]&&rand()%10){
+			rte_free(bench_handle[i]);
+			bench_handle[i] = NULL;
+			live -= BENCH_DEFRAG_SIZE;
+		}
+	}
+	bench_defrag_report("sparse", live);
+	t0 = bench_now();
+	do{
+		nr = rte_slub_defrag(BENCH_DEFRAG_SIZE);
+	}while(nr>0);
+	bench_defrag_report("defrag", live);
+	printf("defrag took %.3f ms\n", (bench_now()-t0)*1000);
+
+	for(i=0;i<BENCH_DEFRAG_OBJS;i++){
+		if(bench_handle[i] && *(uint32_t *)bench_handle[i]!=i){
+			printf("Handle %u is corrupted.\n", i);
+			return -1;
+		}
+	}
+	rte_slub_set_mobility(BENCH_DEFRAG_SIZE, NULL);
+	return 0;
+}
+
+/*
+ * 两个tag共用内存池: tag 2不断分配直到达到hard_limit，之后tag 1的分配不受影响
+ * */
+#define BENCH_TENANT_SIZE 2048
+#define BENCH_TENANT_OBJS 8192
+static void bench_soft_cb(void *arg, unsigned int tag, int64_t pages)
+{
+	printf("tag %u exceeded soft limit: %ld pages\n", tag, pages);
+}
+
+static unsigned int bench_tenant_fill(unsigned int tag, void **obj, unsigned int n)
+{
+	unsigned int i;
+
+	for(i=0;i<n;i++){
+		obj[i] = rte_malloc_tagged(BENCH_TENANT_SIZE, tag);
+		if(NULL==obj[i]){
+			break;
+		}
+	}
+	return i;
+}
+
+static void bench_tenant_report(unsigned int tag, unsigned int nr)
+{
+	struct rte_tag_stat st;
+
+	rte_tag_stat(tag, &st);
+	printf("tag %u: objects=%5u pages=%5ld peak=%5ld soft_events=%lu hard_fails=%lu\n",
+			tag, nr, st.pages, st.peak, st.soft_events, st.hard_fails);
+}
+
+static int bench_tenant(void)
+{
+	static void *obj1[BENCH_TENANT_OBJS], *obj2[BENCH_TENANT_OBJS];
+	unsigned int nr1, nr2, i;
+
+	rte_set_self_id(0);
+	rte_tag_set_soft_cb(bench_soft_cb, NULL);
+	rte_tag_set_limit(2, 4UL<<20, 8UL<<20);
+	nr2 = bench_tenant_fill(2, obj2, BENCH_TENANT_OBJS);
+	nr1 = bench_tenant_fill(1, obj1, BENCH_TENANT_OBJS/2);
+	bench_tenant_report(1, nr1);
+	bench_tenant_report(2, nr2);
+
+	for(i=0;i<nr1;i++){
+		rte_free(obj1[i]);
+	}
+	for(i=0;i<nr2;i++){
+		rte_free(obj2[i]);
+	}
+	rte_slub_shrink();
+	bench_tenant_report(1, 0);
+	bench_tenant_report(2, 0);
+	return 0;
+}
+
+/*
+ * 比较链表与位图两种slab格式。每种格式使用一个新的内存池:
+ * 	ws: 每个线程持有超过L2大小的工作集，随机释放一个Obj再分配一个，Obj多半不在cache中
+ * 	remote: 每轮各线程分配一批Obj，再释放相邻线程分配的那一批
+ * */
+#define BENCH_WS_OBJS 8192
+#define BENCH_WS_SIZE 256
+#define BENCH_REMOTE_BATCH 1024
+static void *bench_remote_obj[RTE_MAX_CPU_NUM][BENCH_REMOTE_BATCH];
+static pthread_barrier_t bench_remote_barrier;
+static int bench_remote_cores;
+
+static void bench_ws_fn(struct bench_thread *t)
+{
+	void **obj = malloc(BENCH_WS_OBJS*sizeof(void *));
+	uint32_t seed = t->id + 1;
+	uint64_t t0;
+	int i, j;
+
+	if(NULL==obj){
+		return;
+	}
+	for(j=0;j<BENCH_WS_OBJS;j++){
+		obj[j] = rte_malloc(BENCH_WS_SIZE);
+	}
+	for(i=0;i<t->iters;){
+		j = bench_rand(&seed)%BENCH_WS_OBJS;
+		t0 = rte_rdtsc();
+		rte_free(obj[j]);
+		t->lat[i++] = rte_rdtsc() - t0;
+		if(i<t->iters){
+			t0 = rte_rdtsc();
+			obj[j] = rte_malloc(BENCH_WS_SIZE);
+			t->lat[i++] = rte_rdtsc() - t0;
+		}else{
+			obj[j] = NULL;
+		}
+	}
+	for(j=0;j<BENCH_WS_OBJS;j++){
+		if(obj[j]){
+			rte_free(obj[j]);
+		}
+	}
+	free(obj);
+}
+
+static void bench_remote_fn(struct bench_thread *t)
+{
+	void **mine = bench_remote_obj[t->id];
+	void **peer = bench_remote_obj[(t->id+1)%bench_remote_cores];
+	uint64_t t0;
+	int i=0, j;
+
+	while(i<t->iters){
+		for(j=0;j<BENCH_REMOTE_BATCH;j++){
+			t0 = rte_rdtsc();
+			mine[j] = rte_malloc(BENCH_WS_SIZE);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+		pthread_barrier_wait(&bench_remote_barrier);
+		for(j=0;j<BENCH_REMOTE_BATCH;j++){
+			t0 = rte_rdtsc();
+			rte_free(peer[j]);
+			if(i<t->iters){
+				t->lat[i++] = rte_rdtsc() - t0;
+			}
+		}
+		pthread_barrier_wait(&bench_remote_barrier);
+	}
+}
+
+static int bench_bitmap(void)
+{
+	static const char *names[] = {"freelist", "bitmap"};
+	char name[32];
+	int format, cores;
+
+	for(format=RTE_SLAB_FREELIST; format<=RTE_SLAB_BITMAP; format++){
+		if(bench_pool_init(BENCH_POOL_PAGES)<0){
+			return -1;
+		}
+		rte_slub_set_format(BENCH_WS_SIZE, format);
+		for(cores=1;cores<=bench_cores;cores++){
+			snprintf(name, sizeof(name), "%s/ws", names[format]);
+			bench_run(name, cores, bench_ws_fn);
+		}
+		for(cores=2;cores<=bench_cores;cores++){
+			bench_remote_cores = cores;
+			pthread_barrier_init(&bench_remote_barrier, NULL, cores);
+			snprintf(name, sizeof(name), "%s/remote", names[format]);
+			bench_run(name, cores, bench_remote_fn);
+			pthread_barrier_destroy(&bench_remote_barrier);
+		}
+	}
+	return 0;
+}
+
+/* 每次操作为分配或释放BENCH_BULK_PAGES个页，逐页调用与批量调用对比，延迟按页平均 */
+#define BENCH_BULK_PAGES 32
+static void bench_single_pages_fn(struct bench_thread *t)
+{
+	struct rte_page *pages[BENCH_BULK_PAGES];
+	uint64_t t0;
+	int i=0, j;
+
+	while(i<t->iters){
+		t0 = rte_rdtsc();
+		for(j=0;j<BENCH_BULK_PAGES;j++){
+			pages[j] = rte_get_pages(0);
+		}
+		t->lat[i++] = (rte_rdtsc() - t0)/BENCH_BULK_PAGES;
+		t0 = rte_rdtsc();
+		for(j=0;j<BENCH_BULK_PAGES;j++){
+			if(pages[j]){
+				rte_free_pages(pages[j]);
+			}
+		}
+		if(i<t->iters){
+			t->lat[i++] = (rte_rdtsc() - t0)/BENCH_BULK_PAGES;
+		}
+	}
+}
+
+static void bench_bulk_pages_fn(struct bench_thread *t)
+{
+	struct rte_page *pages[BENCH_BULK_PAGES];
+	unsigned int nr;
+	uint64_t t0;
+	int i=0;
+
+	while(i<t->iters){
+		t0 = rte_rdtsc();
+		nr = rte_get_pages_bulk(0, BENCH_BULK_PAGES, pages);
+		t->lat[i++] = (rte_rdtsc() - t0)/BENCH_BULK_PAGES;
+		t0 = rte_rdtsc();
+		rte_free_pages_bulk(pages, nr);
+		if(i<t->iters){
+			t->lat[i++] = (rte_rdtsc() - t0)/BENCH_BULK_PAGES;
+		}
+	}
+}
+
+static int bench_bulk(void)
+{
+	unsigned int free_pages = bench_free_pages();
+	int cores;
+
+	for(cores=1;cores<=bench_cores;cores++){
+		bench_run("single", cores, bench_single_pages_fn);
+		bench_run("bulk", cores, bench_bulk_pages_fn);
+	}
+	if(bench_free_pages()!=free_pages){
+		printf("Leaked %u pages.\n", free_pages-bench_free_pages());
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 哈希桶: 1KB的Obj，只访问每个桶开头的cache line，按随机顺序链接成环做指针追逐。
+ * 不着色时桶头只落在页内偏移0/1K/2K/3K对应的少数cache组中，组冲突导致大量miss。
+ * 能使用perf_event时同时统计L1D的读miss
+ * */
+#define BENCH_COLOR_SIZE 1024
+static int bench_l1d_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ<<8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+	attr.exclude_kernel = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t bench_l1d_read(int fd)
+{
+	uint64_t v=0;
+
+	if(fd<0||read(fd, &v, sizeof(v))!=sizeof(v)){
+		return 0;
+	}
+	return v;
+}
+
+static void bench_color_run(int coloring, unsigned int nr, int rounds)
+{
+	void **bucket;
+	void **p;
+	uint64_t t0, cycles, miss0, miss;
+	uint32_t seed=1;
+	unsigned int i, j;
+	int fd, r;
+
+	if(bench_pool_init(BENCH_POOL_PAGES)<0){
+		return;
+	}
+	rte_slub_set_coloring(BENCH_COLOR_SIZE, coloring);
+	bucket = malloc(nr*sizeof(void *));
+	if(NULL==bucket){
+		return;
+	}
+	for(i=0;i<nr;i++){
+		bucket[i] = rte_malloc(BENCH_COLOR_SIZE);
+	}
+	for(i=nr-1;i>0;i--){ // 打乱后链接成环
+		j = bench_rand(&seed)%(i+1);
+		p = bucket[i];
+		bucket[i] = bucket[j];
+		bucket[j] = p;
+	}
+	for(i=0;i<nr;i++){
+		*(void **)bucket[i] = bucket[(i+1)%nr];
+	}
+
+	p = bucket[0];
+	for(i=0;i<nr;i++){
+		p = *p;
+	}
+	fd = bench_l1d_open();
+	miss0 = bench_l1d_read(fd);
+	t0 = rte_rdtsc();
+	for(r=0;r<rounds;r++){
+		for(i=0;i<nr;i++){
+			p = *p;
+		}
+	}
+	cycles = rte_rdtsc() - t0;
+	miss = bench_l1d_read(fd) - miss0;
+	if(fd>=0){
+		close(fd);
+	}
+	__asm__ __volatile__("" :: "r"(p));
+
+	printf("%-8s buckets=%5u  %6.2f cycles/access", coloring ? "color" : "nocolor", nr,
+			(double)cycles/((uint64_t)rounds*nr));
+	if(fd>=0){
+		printf("  L1D misses/access %.3f", (double)miss/((uint64_t)rounds*nr));
+	}
+	printf("\n");
+	for(i=0;i<nr;i++){
+		rte_free(bucket[i]);
+	}
+	free(bucket);
+}
+
+static int bench_color(void)
+{
+	static const unsigned int nr[] = {256, 512, 2048, 8192};
+	unsigned int i;
+	int rounds;
+
+	for(i=0;i<sizeof(nr)/sizeof(nr[0]);i++){
+		rounds = bench_iters/nr[i] ? bench_iters/nr[i] : 1;
+		bench_color_run(0, nr[i], rounds);
+		bench_color_run(1, nr[i], rounds);
+	}
+	return 0;
+}
+
+/*
+ * 启动后最初的分配: 冷启动时各Core同时进入new_slab，预热后直接走快速路径。
+ * 每个Core分配BENCH_WARM_OBJS个Obj，之后全部释放，再检查预留的slab没有被收缩
+ * */
+#define BENCH_WARM_SIZE 2048
+#define BENCH_WARM_OBJS 1000
+static void bench_warm_fn(struct bench_thread *t)
+{
+	void **obj = malloc(t->iters*sizeof(void *));
+	uint64_t t0, cycles;
+	int i, n=0;
+
+	if(NULL==obj){
+		t->failed = t->iters;
+		return;
+	}
+	for(i=0;i<t->iters;i++){
+		t0 = rte_rdtsc();
+		obj[i] = rte_malloc(BENCH_WARM_SIZE);
+		cycles = rte_rdtsc() - t0;
+		if(NULL==obj[i]){
+			t->failed++;
+			continue;
+		}
+		t->lat[n++] = cycles;
+	}
+	for(i=0;i<t->iters;i++){
+		if(obj[i]){
+			rte_free(obj[i]);
+		}
+	}
+	free(obj);
+}
+
+static int bench_warmup(void)
+{
+	struct rte_mem_reserve res = {BENCH_WARM_SIZE, 0};
+	struct rte_mem_cache *caches;
+	int cache_num, i, prewarm;
+	int iters = bench_iters;
+
+	bench_iters = BENCH_WARM_OBJS; // 不使用-n，两次运行都能装入内存池
+	for(prewarm=0; prewarm<=1; prewarm++){
+		if(bench_pool_init(BENCH_POOL_PAGES)<0){
+			return -1;
+		}
+		if(prewarm){
+			res.objects = bench_cores*BENCH_WARM_OBJS;
+			if(rte_slub_prewarm(&res, 1, bench_cores)<0){
+				printf("Failed to reserve %u objects.\n", res.objects);
+				bench_iters = iters;
+				return -1;
+			}
+		}
+		bench_run(prewarm ? "prewarm" : "cold", bench_cores, bench_warm_fn);
+		for(i=0;i<4;i++){ // 空闲的cache会被逐步收缩
+			rte_slub_maintain(NULL);
+		}
+		caches = rte_slub_caches(&cache_num);
+		for(i=0;i<cache_num;i++){
+			if(caches[i].size==BENCH_WARM_SIZE){
+				printf("after trimming: partial slabs=%lu reserved=%lu\n",
+						caches[i].local_node.nr_partial, caches[i].reserved);
+			}
+		}
+	}
+	bench_iters = iters;
+	return 0;
+}
+
+/*
+ * 文件I/O: 队列深度BENCH_URING_QD，每次读写文件中随机位置的一个块，块由rte_get_pages分配。
+ * 同样的负载先用普通的READ/WRITE，再把zone注册为固定缓冲区后用READ_FIXED/WRITE_FIXED。
+ * 能使用O_DIRECT时绕过page cache，普通模式下每次I/O都要pin用户页，
+ * 差别主要体现在每次I/O的系统CPU时间上
+ * */
+#define BENCH_URING_FILE "rte_bench.uring"
+#define BENCH_URING_FILE_PAGES 16384
+#define BENCH_URING_QD 32
+
+static double bench_sys_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6;
+}
+
+static void bench_uring_prep(struct rte_uring *ring, int fd, int write, void *buf,
+		uint32_t len, uint32_t *seed, uint64_t user_data)
+{
+	uint64_t off = (uint64_t)(bench_rand(seed)%(BENCH_URING_FILE_PAGES*RTE_PAGE_SIZE/len))*len;
+
+	if(write){
+		rte_uring_prep_write(ring, fd, buf, len, off, user_data);
+	}else{
+		rte_uring_prep_read(ring, fd, buf, len, off, user_data);
+	}
+}
+
+static int bench_uring_run(struct rte_uring *ring, int fd, int write, unsigned int order)
+{
+	struct rte_page *page[BENCH_URING_QD];
+	void *buf[BENCH_URING_QD];
+	uint64_t start[BENCH_URING_QD];
+	uint64_t *lat, user_data;
+	uint32_t seed=1, len=RTE_PAGE_SIZE<<order;
+	double t0, sys0, elapsed, sys;
+	long issued=0, done=0;
+	int i, res, ret=0;
+
+	lat = malloc(bench_iters*sizeof(uint64_t));
+	if(NULL==lat){
+		return -1;
+	}
+	for(i=0;i<BENCH_URING_QD;i++){
+		page[i] = rte_get_pages(order);
+		if(NULL==page[i]){
+			printf("Failed to alloc I/O buffers.\n");
+			while(i--){
+				rte_free_pages(page[i]);
+			}
+			free(lat);
+			return -1;
+		}
+		buf[i] = rte_page_to_virt(page[i]);
+	}
+	ring->nr_fixed = ring->nr_plain = 0;
+
+	t0 = bench_now();
+	sys0 = bench_sys_time();
+	for(i=0;i<BENCH_URING_QD&&issued<bench_iters;i++,issued++){
+		start[i] = rte_rdtsc();
+		bench_uring_prep(ring, fd, write, buf[i], len, &seed, i);
+	}
+	while(done<issued){
+		if(rte_uring_wait(ring, &user_data, &res)<0){
+			printf("io_uring_enter failed: %s\n", strerror(errno));
+			ret = -1;
+			break;
+		}
+		if(res!=(int)len){
+			if(res<0){
+				printf("I/O failed: %s\n", strerror(-res));
+			}else{
+				printf("I/O failed: short %s %d/%u\n", write ? "write" : "read", res, len);
+			}
+			ret = -1;
+			break;
+		}
+		lat[done++] = rte_rdtsc() - start[user_data];
+		if(issued<bench_iters){
+			start[user_data] = rte_rdtsc();
+			bench_uring_prep(ring, fd, write, buf[user_data], len, &seed, user_data);
+			issued++;
+		}
+	}
+	while(done<issued&&rte_uring_wait(ring, &user_data, &res)>0){ // 出错时收割剩余的I/O
+		done++;
+	}
+	elapsed = bench_now() - t0;
+	sys = bench_sys_time() - sys0;
+
+	if(!ret){
+		qsort(lat, done, sizeof(uint64_t), cmp_u64);
+		printf("%-5s %-5s %3uKB  %9.0f IOPS  sys %6.2f us/io  p50 %9lu  p99 %9lu cycles\n",
+				write ? "write" : "read", ring->nr_fixed ? "fixed" : "plain", len>>10,
+				done/elapsed, sys*1e6/done, lat[done/2], lat[done*99/100]);
+	}
+	for(i=0;i<BENCH_URING_QD;i++){
+		rte_free_pages(page[i]);
+	}
+	free(lat);
+	return ret;
+}
+
+static int bench_uring(void)
+{
+	static const unsigned int order[] = {0, 4};
+	struct rte_uring ring;
+	struct rte_page *page;
+	void *fill;
+	unsigned int i;
+	int fd, direct=1, write, ret=0;
+	size_t off;
+
+	fd = open(BENCH_URING_FILE, O_RDWR|O_CREAT|O_TRUNC|O_DIRECT, 0644);
+	if(fd<0){ // 例如tmpfs不支持O_DIRECT
+		direct = 0;
+		fd = open(BENCH_URING_FILE, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	}
+	if(fd<0){
+		perror("open");
+		return -1;
+	}
+	unlink(BENCH_URING_FILE);
+
+	/* 写入实际的数据，避免读到空洞时不访问设备 */
+	page = rte_get_pages(RTE_MAX_ORDER-1);
+	if(NULL==page){
+		close(fd);
+		return -1;
+	}
+	fill = rte_page_to_virt(page);
+	memset(fill, 0x5a, RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1));
+	for(off=0; off<(size_t)BENCH_URING_FILE_PAGES*RTE_PAGE_SIZE; off+=RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1)){
+		if(pwrite(fd, fill, RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1), off)<0){
+			perror("pwrite");
+			rte_free_pages(page);
+			close(fd);
+			return -1;
+		}
+	}
+	rte_free_pages(page);
+	fsync(fd);
+
+	if(rte_uring_init(&ring, BENCH_URING_QD)<0){
+		printf("io_uring is not available: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	printf("file %uMB %s, queue depth %d\n", BENCH_URING_FILE_PAGES*RTE_PAGE_SIZE>>20,
+			direct ? "O_DIRECT" : "buffered", BENCH_URING_QD);
+	for(i=0;i<sizeof(order)/sizeof(order[0])&&!ret;i++){
+		for(write=0;write<=1&&!ret;write++){
+			ret = bench_uring_run(&ring, fd, write, order[i]);
+			if(ret){
+				break;
+			}
+			if(rte_uring_register(&ring, NULL)<0){
+				printf("Failed to register fixed buffers: %s\n", strerror(errno));
+				ret = -1;
+				break;
+			}
+			ret = bench_uring_run(&ring, fd, write, order[i]);
+			rte_uring_unregister(&ring);
+		}
+	}
+	rte_uring_exit(&ring);
+	close(fd);
+	return ret;
+}
+
+struct bench_case{
+	const char *name;
+	int (*fn)(void);
+};
+
+static struct bench_case bench_cases[] = {
+	{"lock", bench_lock},
+	{"churn", bench_churn},
+	{"rcu", bench_rcu},
+	{"latency", bench_latency},
+	{"mempool", bench_mempool},
+	{"frag", bench_frag},
+	{"defrag", bench_defrag},
+	{"tenant", bench_tenant},
+	{"bitmap", bench_bitmap},
+	{"bulk", bench_bulk},
+	{"color", bench_color},
+	{"warmup", bench_warmup},
+	{"uring", bench_uring},
+};
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+	printf("usage: %s <case> [-c cores] [-n iterations] [-t trace]\n", prog);
+	printf("cases:");
+	for(i=0;i<sizeof(bench_cases)/sizeof(bench_cases[0]);i++){
+		printf(" %s", bench_cases[i].name);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *trace=NULL;
+	unsigned int i;
+	int opt, ret;
+
+	if(argc<2){
+		usage(argv[0]);
+		return -1;
+	}
+	optind = 2;
+	while((opt=getopt(argc, argv, "c:n:t:"))!=-1){
+		switch(opt){
+		case 'c':
+			bench_cores = atoi(optarg);
+			break;
+		case 'n':
+			bench_iters = atoi(optarg);
+			break;
+		case 't':
+			trace = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(bench_cores<1||bench_cores>RTE_MAX_CPU_NUM||bench_iters<1){
+		usage(argv[0]);
+		return -1;
+	}
+
+	if(bench_pool_init(BENCH_POOL_PAGES)<0){
+		printf("Failed to init memory pool.\n");
+		return -1;
+	}
+	for(i=0;i<sizeof(bench_cases)/sizeof(bench_cases[0]);i++){
+		if(!strcmp(argv[1], bench_cases[i].name)){
+			if(trace&&rte_trace_start(trace)<0){
+				printf("Failed to open trace file %s.\n", trace);
+				return -1;
+			}
+			ret = bench_cases[i].fn();
+			rte_trace_stop();
+			return ret;
+		}
+	}
+	usage(argv[0]);
+	return -1;
+}
@@ -1,14 +1,58 @@
 /*
  * */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "rte_buddy.h"
+#include "rte_trace.h"
+#include "rte_tag.h"
 
 static struct rte_mem_zone *global_mem_zone; 
 
+__thread int rte_self_id;
+__thread unsigned int rte_buddy_split;
+
+static inline void arena_lock(struct rte_buddy_arena *arena)
+{
+	rte_lock_lock(RTE_ZONE_LOCK, &arena->lock);
+}
+
+static inline void arena_unlock(struct rte_buddy_arena *arena)
+{
+	rte_lock_unlock(RTE_ZONE_LOCK, &arena->lock);
+}
+
+/* 页所属的arena序号，记录在page->flags的高位中 */
 static inline int page_zone_id(struct rte_page *page)
 {
-	return 0;	
+	return page->flags>>RTE_PAGE_ARENA_SHIFT;
+}
+
+static inline void set_page_zone_id(struct rte_page *page, unsigned int id)
+{
+	page->flags &= ((1UL<<RTE_PAGE_ARENA_SHIFT)-1);
+	page->flags |= ((uint64_t)id<<RTE_PAGE_ARENA_SHIFT);
+}
+
+static inline unsigned int page_tag(struct rte_page *page)
+{
+	return (page->flags>>RTE_PAGE_TAG_SHIFT)&RTE_PAGE_TAG_MASK;
+}
+
+static inline void set_page_tag(struct rte_page *page, unsigned int tag)
+{
+	page->flags &= ~(RTE_PAGE_TAG_MASK<<RTE_PAGE_TAG_SHIFT);
+	page->flags |= ((uint64_t)tag<<RTE_PAGE_TAG_SHIFT);
+}
+
+static inline struct rte_buddy_arena *page_arena(struct rte_mem_zone *zone, struct rte_page *page)
+{
+	return zone->arena + page_zone_id(page);
+}
+
+static inline struct rte_buddy_arena *local_arena(struct rte_mem_zone *zone)
+{
+	return zone->arena + (rte_get_self_id() % zone->arena_num);
 }
 
 #define page_private(page) ((page)->private)
@@ -98,9 +142,10 @@ static int destroy_compound_page(struct rte_page *page, unsigned int order)
  * 	page: 指向组合页首页的描述符。组合页可视为页的数组
  *	low: 目标页的大小(order值)
  *	high: 要分裂的组合页的大小(order值)
+ *	type: 分裂剩余的页放入的链表，即页所在pageblock的类型
  * */
-static inline void expand(struct rte_mem_zone *zone, struct rte_page *page,
-				unsigned int low, unsigned int high, struct free_area *area)
+static inline void expand(struct rte_buddy_arena *arena, struct rte_page *page,
+				unsigned int low, unsigned int high, struct free_area *area, int type)
 {
 	unsigned int size=(1U<<high);
 
@@ -108,77 +153,382 @@ static inline void expand(struct rte_mem_zone *zone, struct rte_page *page,
 		area--;
 		high--;
 		size >>= 1;
-		list_add(&page[size].lru, &area->free_list);
+		list_add(&page[size].lru, &area->free_list[type]);
 		area->nr_free++;
 		set_page_order(&page[size], high);
 	}
 }
 
-static struct rte_page *__alloc_page(unsigned int order, struct rte_mem_zone *zone)
+/* 页所在pageblock(最大块)的首页 */
+static inline struct rte_page *block_head(struct rte_mem_zone *zone, struct rte_page *page)
 {
-	struct rte_page *page=NULL;
-	struct free_area *area=NULL;
-	unsigned int current_order=0;
+	uint64_t idx = page - zone->first_page;
+
+	return zone->first_page + (idx & ~((1UL<<(RTE_MAX_ORDER-1))-1));
+}
+
+static inline int get_block_type(struct rte_mem_zone *zone, struct rte_page *page)
+{
+	return (block_head(zone, page)->flags>>RTE_PAGE_MIGRATE_SHIFT)&RTE_PAGE_MIGRATE_MASK;
+}
+
+/* 只在整个pageblock空闲(首页不属于任何使用者)时修改，因此不需要原子操作 */
+static inline void set_block_type(struct rte_mem_zone *zone, struct rte_page *page, int type)
+{
+	struct rte_page *head = block_head(zone, page);
+
+	head->flags &= ~(RTE_PAGE_MIGRATE_MASK<<RTE_PAGE_MIGRATE_SHIFT);
+	head->flags |= ((uint64_t)type<<RTE_PAGE_MIGRATE_SHIFT);
+}
+
+static inline int gfp_migratetype(unsigned int flags)
+{
+#ifdef RTE_BUDDY_NO_GROUPING
+	return RTE_MIGRATE_LARGE;
+#else
+	return (flags&RTE_GFP_SLAB) ? RTE_MIGRATE_SLAB : RTE_MIGRATE_LARGE;
+#endif
+}
+
+/* 从current_order的type链表中取出一块，分裂出order大小的页 */
+static struct rte_page *__rmqueue_take(struct rte_buddy_arena *arena, unsigned int order,
+				unsigned int current_order, int type)
+{
+	struct free_area *area = arena->free_area + current_order;
+	struct rte_page *page;
+
+	page = list_entry(area->free_list[type].next, struct rte_page, lru);
+	list_del(&page->lru);
+	rmv_page_order(page);
+	area->nr_free--;
+	rte_buddy_split = current_order - order;
+	expand(arena, page, order, current_order, area, type);
+	if(order){
+		prepare_compound_page(page, order);
+	}
+	arena->free_zero_num -= (1<<order);
+	return page;
+}
+
+static struct rte_page *__rmqueue_smallest(struct rte_buddy_arena *arena, unsigned int order, int type)
+{
+	unsigned int current_order;
 
 	for(current_order=order; current_order<RTE_MAX_ORDER; current_order++){
-		area = zone->free_area + current_order;
-		if(list_empty(&area->free_list)){
+		if(!list_empty(&arena->free_area[current_order].free_list[type])){
+			return __rmqueue_take(arena, order, current_order, type);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * type类型没有足够的空闲页时: 优先把其他类型的一个空闲pageblock整块改为type类型；
+ * 没有整块空闲的pageblock时，才从其他类型最大的空闲块中分配，该块的类型不变
+ * */
+static struct rte_page *__rmqueue_fallback(struct rte_mem_zone *zone, struct rte_buddy_arena *arena,
+				unsigned int order, int type)
+{
+	struct free_area *area = arena->free_area + RTE_MAX_ORDER - 1;
+	struct rte_page *page;
+	int current_order;
+	int fallback;
+
+	for(fallback=0; fallback<RTE_MIGRATE_TYPES; fallback++){
+		if(fallback==type||list_empty(&area->free_list[fallback])){
 			continue;
 		}
-		page = list_entry(area->free_list.next, struct rte_page, lru);
+		page = list_entry(area->free_list[fallback].next, struct rte_page, lru);
 		list_del(&page->lru);
-		rmv_page_order(page);
-		area->nr_free--;
-		expand(zone, page, order, current_order, area);
-		if(page && order){
-			prepare_compound_page(page, order);
+		list_add(&page->lru, &area->free_list[type]);
+		set_block_type(zone, page, type);
+		arena->nr_block_steal++;
+		return __rmqueue_take(arena, order, RTE_MAX_ORDER-1, type);
+	}
+
+	for(current_order=RTE_MAX_ORDER-2; current_order>=(int)order; current_order--){
+		area = arena->free_area + current_order;
+		for(fallback=0; fallback<RTE_MIGRATE_TYPES; fallback++){
+			if(fallback!=type && !list_empty(&area->free_list[fallback])){
+				arena->nr_fallback++;
+				return __rmqueue_take(arena, order, current_order, fallback);
+			}
 		}
-		zone->free_zero_num -= (1<<order);
+	}
+	return NULL;
+}
+
+static struct rte_page *__alloc_page(unsigned int order, struct rte_buddy_arena *arena, int type)
+{
+	struct rte_page *page;
+
+	page = __rmqueue_smallest(arena, order, type);
+	if(unlikely(NULL==page)){
+		page = __rmqueue_fallback(global_mem_zone, arena, order, type);
+	}
+	return page;
+}
+
+/*
+ * 本地arena为空时，从其他arena中窃取一个最大块，归入本地arena后再分配。
+ * 若所有arena都没有最大块，则直接从其他arena中分配，页仍归属原arena。
+ * */
+static struct rte_page *steal_and_alloc_page(unsigned int order, int type, struct rte_mem_zone *zone,
+				struct rte_buddy_arena *local)
+{
+	struct rte_buddy_arena *arena;
+	struct free_area *area;
+	struct rte_page *page=NULL;
+	unsigned int i, id;
+	unsigned int nr_pages = 1U<<(RTE_MAX_ORDER-1);
+	int t;
+
+	id = local - zone->arena;
+	for(i=1; i<zone->arena_num; i++){
+		arena = zone->arena + (id+i)%zone->arena_num;
+		area = arena->free_area + RTE_MAX_ORDER - 1;
+		if(!area->nr_free){
+			continue;
+		}
+		arena_lock(arena);
+		for(t=0; t<RTE_MIGRATE_TYPES && !page; t++){
+			if(!list_empty(&area->free_list[t])){
+				page = list_entry(area->free_list[t].next, struct rte_page, lru);
+				list_del(&page->lru);
+				area->nr_free--;
+				arena->free_zero_num -= nr_pages;
+			}
+		}
+		arena_unlock(arena);
+		if(page){
+			break;
+		}
+	}
+
+	if(page){
+		/* 该块已不在任何arena的链表中，可以无锁地修改其归属 */
+		for(i=0; i<nr_pages; i++){
+			set_page_zone_id(page+i, id);
+		}
+		arena_lock(local);
+		list_add(&page->lru, &local->free_area[RTE_MAX_ORDER-1].free_list[get_block_type(zone, page)]);
+		local->free_area[RTE_MAX_ORDER-1].nr_free++;
+		local->free_zero_num += nr_pages;
+		page = __alloc_page(order, local, type);
+		arena_unlock(local);
 		return page;
 	}
+
+	for(i=1; i<zone->arena_num; i++){
+		arena = zone->arena + (id+i)%zone->arena_num;
+		arena_lock(arena);
+		page = __alloc_page(order, arena, type);
+		arena_unlock(arena);
+		if(page){
+			return page;
+		}
+	}
 	return NULL;
 }
 
-struct rte_page *rte_get_pages(unsigned int order)
+#define RTE_MAX_PRESSURE_CB 8
+static struct{
+	rte_pressure_cb_t cb;
+	void *arg;
+}pressure_cbs[RTE_MAX_PRESSURE_CB];
+static int nr_pressure_cb;
+
+/* 注册内存压力回调，空闲页低于low水位时被调用。回调中不能持有arena->lock */
+int rte_register_pressure_cb(rte_pressure_cb_t cb, void *arg)
+{
+	if(nr_pressure_cb>=RTE_MAX_PRESSURE_CB){
+		return -1;
+	}
+	pressure_cbs[nr_pressure_cb].cb = cb;
+	pressure_cbs[nr_pressure_cb].arg = arg;
+	nr_pressure_cb++;
+	return 0;
+}
+
+static inline uint32_t zone_free_pages(struct rte_mem_zone *zone)
+{
+	uint32_t i, nr=0;
+
+	for(i=0; i<zone->arena_num; i++){
+		nr += zone->arena[i].free_zero_num;
+	}
+	return nr;
+}
+
+struct rte_mem_zone *rte_buddy_zone(void)
+{
+	return global_mem_zone;
+}
+
+uint32_t rte_zone_free_pages(void)
+{
+	return zone_free_pages(global_mem_zone);
+}
+
+int rte_zone_set_watermarks(uint32_t min, uint32_t low, uint32_t high)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+
+	if(min>low||low>high||high>zone->page_num){
+		return -1;
+	}
+	zone->watermark[WMARK_MIN] = min;
+	zone->watermark[WMARK_LOW] = low;
+	zone->watermark[WMARK_HIGH] = high;
+	return 0;
+}
+
+/* 空闲页跌破low水位时，由第一个发现的线程调用所有的压力回调 */
+static void zone_check_pressure(struct rte_mem_zone *zone)
+{
+	uint32_t nr_free = zone_free_pages(zone);
+	int i;
+
+	if(likely(nr_free>=zone->watermark[WMARK_LOW]) || zone->pressure){
+		return;
+	}
+	if(!__sync_bool_compare_and_swap(&zone->pressure, 0, 1)){
+		return;
+	}
+	for(i=0; i<nr_pressure_cb; i++){
+		pressure_cbs[i].cb(pressure_cbs[i].arg, nr_free);
+	}
+}
+
+static inline void zone_clear_pressure(struct rte_mem_zone *zone)
+{
+	if(unlikely(zone->pressure) && zone_free_pages(zone)>=zone->watermark[WMARK_HIGH]){
+		zone->pressure = 0;
+	}
+}
+
+/* 块中的页是否都在同一个物理段中，或者所在的各个物理段首尾相接 */
+static int block_phys_contig(struct rte_mem_zone *zone, struct rte_page *page, unsigned int order)
+{
+	uint64_t first = (uint64_t)(page - zone->first_page)<<RTE_PAGE_SHIFT;
+	uint64_t last = first + ((uint64_t)RTE_PAGE_SIZE<<order) - 1;
+	uint64_t seg;
+
+	if(NULL==zone->phys_table){
+		return 0;
+	}
+	for(seg=first>>zone->phys_shift; seg<(last>>zone->phys_shift); seg++){
+		if(zone->phys_table[seg]+(1UL<<zone->phys_shift)!=zone->phys_table[seg+1]){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * 分配物理上连续的块: 物理不连续的块先保留，最多尝试RTE_CONTIG_RETRY次，
+ * 结束后归还所有被拒绝的块。物理地址未知时分配失败
+ * */
+#define RTE_CONTIG_RETRY 8
+static struct rte_page *alloc_contig_pages(struct rte_mem_zone *zone, unsigned int order,
+				unsigned int flags)
+{
+	struct rte_page *rejected[RTE_CONTIG_RETRY];
+	struct rte_page *page = NULL;
+	struct rte_page *p;
+	int i, n=0;
+
+	if(NULL==zone->phys_table){
+		return NULL;
+	}
+	while(n<RTE_CONTIG_RETRY){
+		p = __rte_get_pages(order, flags&~RTE_GFP_CONTIG);
+		if(NULL==p){
+			break;
+		}
+		if(block_phys_contig(zone, p, order)){
+			page = p;
+			break;
+		}
+		rejected[n++] = p;
+	}
+	for(i=0; i<n; i++){
+		__rte_free_pages(rejected[i]);
+	}
+	return page;
+}
+
+struct rte_page *__rte_get_pages(unsigned int order, unsigned int flags)
 {
 	struct rte_page *page = NULL;
 	struct rte_mem_zone *zone = global_mem_zone;
+	struct rte_buddy_arena *arena = local_arena(zone);
+	int type = gfp_migratetype(flags);
+	unsigned int tag = rte_tag_get();
 
 	if(order>=RTE_MAX_ORDER){
 		RTE_BUDDY_BUG(__FILE__, __LINE__);
 		return NULL;
 	}
-	rte_spinlock_lock(&zone->lock);
-	page = __alloc_page(order, zone);
-	rte_spinlock_unlock(&zone->lock);
+	if(unlikely(flags&RTE_GFP_CONTIG)){
+		return alloc_contig_pages(zone, order, flags);
+	}
+	/* min水位以下的页保留给紧急分配 */
+	if(!(flags&RTE_GFP_CRITICAL) &&
+	   zone_free_pages(zone)<zone->watermark[WMARK_MIN]+(1U<<order)){
+		zone_check_pressure(zone);
+		return NULL;
+	}
+	if(unlikely(tag) && rte_tag_charge(tag, 1U<<order)<0){
+		return NULL;
+	}
+	arena_lock(arena);
+	page = __alloc_page(order, arena, type);
+	arena_unlock(arena);
+	if(unlikely(NULL==page) && zone->arena_num>1){
+		page = steal_and_alloc_page(order, type, zone, arena);
+	}
+	if(unlikely(tag)){
+		if(page){
+			set_page_tag(page, tag);
+		}else{
+			rte_tag_uncharge(tag, 1U<<order);
+		}
+	}
+	zone_check_pressure(zone);
 	return page;
 }
 
-void rte_free_pages(struct rte_page *page)
+struct rte_page *rte_get_pages(unsigned int order)
+{
+	struct rte_page *page = __rte_get_pages(order, 0);
+
+	rte_trace_event(RTE_TRACE_GET_PAGES, page ? rte_page_to_virt(page) : NULL, order, 0);
+	rte_tag_soft_notify();
+	return page;
+}
+
+/* 把一个order大小的块归还到arena中, 并与空闲的buddy合并。调用者持有arena->lock */
+static void __free_one_page(struct rte_mem_zone *zone, struct rte_buddy_arena *arena,
+				struct rte_page *page, uint32_t order)
 {
-	struct rte_mem_zone *zone = global_mem_zone;	
 	uint64_t page_idx = (page - zone->first_page);
 	uint64_t buddy_idx = 0;
-	uint32_t order = compound_order(page);
 
-	rte_spinlock_lock(&zone->lock);
-	if(unlikely(PageCompound(page))){
-		if(unlikely(destroy_compound_page(page, order))){
-			RTE_BUDDY_BUG(__FILE__, __LINE__);
-		}
-	}
-
-	zone->free_zero_num += (1<<order);	
+	arena->free_zero_num += (1<<order);	
 	while(order<RTE_MAX_ORDER-1){
 		uint64_t combinded_idx;
 		struct rte_page *buddy;
 		buddy_idx = __find_buddy_index(page_idx, order);
+		if(buddy_idx>=zone->page_num){ // zone末尾不足一个最大块的页没有buddy
+			break;
+		}
 		buddy = page + (buddy_idx - page_idx); /* buddy_idx=0, page_idx=1时,为什么没有出问题？若XXX_idx定义为uint32_t时呢？*/
 		if(!page_is_buddy(page, buddy, order)){
 			break;
 		}
 		list_del(&buddy->lru);
-		zone->free_area[order].nr_free--;
+		arena->free_area[order].nr_free--;
 		rmv_page_order(buddy);
 		combinded_idx = __find_combined_index(page_idx, order);
 		page = page + (combinded_idx - page_idx);
@@ -187,12 +537,336 @@ void rte_free_pages(struct rte_page *page)
 	}
 
 	set_page_order(page, order);
-	list_add(&page->lru, &zone->free_area[order].free_list);
-	zone->free_area[order].nr_free++;
-	rte_spinlock_unlock(&zone->lock);
+	list_add(&page->lru, &arena->free_area[order].free_list[get_block_type(zone, page)]);
+	arena->free_area[order].nr_free++;
+}
+
+/*
+ * 把连续的nr_pages个页归还到arena中，按对齐的最大块拆分后逐块归还。
+ * 调用者持有arena->lock
+ * */
+static void __free_pages_range(struct rte_mem_zone *zone, struct rte_buddy_arena *arena,
+				struct rte_page *page, unsigned int nr_pages)
+{
+	uint64_t page_idx = (page - zone->first_page);
+	uint64_t end_idx = page_idx + nr_pages;
+	uint32_t order;
+
+	while(page_idx<end_idx){
+		order = 0;
+		while(order<RTE_MAX_ORDER-1 && !(page_idx & (1UL<<order)) &&
+			  page_idx+(2UL<<order)<=end_idx){
+			order++;
+		}
+		__free_one_page(zone, arena, zone->first_page+page_idx, order);
+		page_idx += (1UL<<order);
+	}
+}
+
+void __rte_free_pages(struct rte_page *page)
+{
+	struct rte_mem_zone *zone = global_mem_zone;	
+	struct rte_buddy_arena *arena = page_arena(zone, page);
+	uint32_t order = compound_order(page);
+	unsigned int tag = page_tag(page);
+
+	if(unlikely(tag)){
+		set_page_tag(page, 0);
+		rte_tag_uncharge(tag, 1U<<order);
+	}
+	arena_lock(arena);
+	if(unlikely(PageCompound(page))){
+		if(unlikely(destroy_compound_page(page, order))){
+			RTE_BUDDY_BUG(__FILE__, __LINE__);
+		}
+	}
+	__free_one_page(zone, arena, page, order);
+	arena_unlock(arena);
+	zone_clear_pressure(zone);
 	return;
 }
 
+void rte_free_pages(struct rte_page *page)
+{
+	rte_trace_event(RTE_TRACE_FREE_PAGES, rte_page_to_virt(page), 0, 0);
+	__rte_free_pages(page);
+}
+
+/*
+ * 从arena中分配最多n个order大小的块，调用者持有arena->lock。
+ * 剩余的块数不少于一个更大的空闲块所含的块数时，直接把这个大块整个切开，
+ * 不再逐级放回较小的空闲链表
+ * */
+static unsigned int __rmqueue_bulk(struct rte_mem_zone *zone, struct rte_buddy_arena *arena,
+				unsigned int order, int type, unsigned int n, struct rte_page **pages)
+{
+	struct free_area *area;
+	struct rte_page *page;
+	unsigned int current_order, nr, i, got=0;
+
+	while(got<n){
+		for(current_order=order; current_order<RTE_MAX_ORDER; current_order++){
+			if(!list_empty(&arena->free_area[current_order].free_list[type])){
+				break;
+			}
+		}
+		if(current_order>=RTE_MAX_ORDER){
+			page = __rmqueue_fallback(zone, arena, order, type);
+			if(NULL==page){
+				break;
+			}
+			pages[got++] = page;
+			continue;
+		}
+		nr = 1U<<(current_order-order);
+		if(nr>n-got){
+			pages[got++] = __rmqueue_take(arena, order, current_order, type);
+			continue;
+		}
+		area = arena->free_area + current_order;
+		page = list_entry(area->free_list[type].next, struct rte_page, lru);
+		list_del(&page->lru);
+		rmv_page_order(page);
+		area->nr_free--;
+		arena->free_zero_num -= (1U<<current_order);
+		rte_buddy_split = current_order - order;
+		for(i=0; i<nr; i++){
+			if(order){
+				prepare_compound_page(page+(i<<order), order);
+			}
+			pages[got++] = page + (i<<order);
+		}
+	}
+	return got;
+}
+
+/*
+ * 一次分配n个order大小的块，放入pages中，返回实际分配的个数(空闲页不足时可能少于n)。
+ * 本地arena只加锁一次，不足的部分再从其他arena中窃取
+ * */
+unsigned int __rte_get_pages_bulk(unsigned int order, unsigned int n, struct rte_page **pages,
+				unsigned int flags)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+	struct rte_buddy_arena *arena = local_arena(zone);
+	int type = gfp_migratetype(flags);
+	unsigned int tag = rte_tag_get();
+	uint32_t nr_free, reserve;
+	unsigned int got, i;
+	struct rte_page *page;
+
+	if(order>=RTE_MAX_ORDER||(flags&RTE_GFP_CONTIG)){
+		RTE_BUDDY_BUG(__FILE__, __LINE__);
+		return 0;
+	}
+	/* min水位以下的页保留给紧急分配 */
+	if(!(flags&RTE_GFP_CRITICAL)){
+		nr_free = zone_free_pages(zone);
+		reserve = zone->watermark[WMARK_MIN];
+		if(nr_free<reserve+(1U<<order)){
+			zone_check_pressure(zone);
+			return 0;
+		}
+		if(n>(nr_free-reserve)>>order){
+			n = (nr_free-reserve)>>order;
+		}
+	}
+	if(unlikely(tag) && rte_tag_charge(tag, n<<order)<0){
+		return 0;
+	}
+	arena_lock(arena);
+	got = __rmqueue_bulk(zone, arena, order, type, n, pages);
+	arena_unlock(arena);
+	while(unlikely(got<n) && zone->arena_num>1){
+		page = steal_and_alloc_page(order, type, zone, arena);
+		if(NULL==page){
+			break;
+		}
+		pages[got++] = page;
+	}
+	if(unlikely(tag)){
+		for(i=0; i<got; i++){
+			set_page_tag(pages[i], tag);
+		}
+		if(got<n){
+			rte_tag_uncharge(tag, (n-got)<<order);
+		}
+	}
+	zone_check_pressure(zone);
+	return got;
+}
+
+unsigned int rte_get_pages_bulk(unsigned int order, unsigned int n, struct rte_page **pages)
+{
+	unsigned int i, got = __rte_get_pages_bulk(order, n, pages, 0);
+
+	if(unlikely(rte_trace_enabled)){
+		for(i=0; i<got; i++){
+			rte_trace_event(RTE_TRACE_GET_PAGES, rte_page_to_virt(pages[i]), order, 0);
+		}
+	}
+	rte_tag_soft_notify();
+	return got;
+}
+
+static int cmp_page(const void *a, const void *b)
+{
+	const struct rte_page *x = *(struct rte_page * const *)a;
+	const struct rte_page *y = *(struct rte_page * const *)b;
+
+	return (x>y)-(x<y);
+}
+
+/*
+ * 释放n个块(可以是不同的order)。先按页的序号排序，相邻的buddy依次归还，
+ * 一趟即可合并；连续属于同一arena的块只加锁一次。pages中的顺序会被改变
+ * */
+void __rte_free_pages_bulk(struct rte_page **pages, unsigned int n)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+	struct rte_buddy_arena *arena, *locked=NULL;
+	struct rte_page *page;
+	unsigned int i, tag;
+	uint32_t order;
+
+	/* 扣除tag计数可能调用soft_limit回调，回调中可能释放内存，因此在加锁之前完成 */
+	for(i=0; i<n; i++){
+		tag = page_tag(pages[i]);
+		if(unlikely(tag)){
+			set_page_tag(pages[i], 0);
+			rte_tag_uncharge(tag, 1U<<compound_order(pages[i]));
+		}
+	}
+	if(n>1){
+		qsort(pages, n, sizeof(struct rte_page *), cmp_page);
+	}
+	for(i=0; i<n; i++){
+		page = pages[i];
+		order = compound_order(page);
+		arena = page_arena(zone, page);
+		if(arena!=locked){
+			if(locked){
+				arena_unlock(locked);
+			}
+			arena_lock(arena);
+			locked = arena;
+		}
+		if(unlikely(PageCompound(page))){
+			if(unlikely(destroy_compound_page(page, order))){
+				RTE_BUDDY_BUG(__FILE__, __LINE__);
+			}
+		}
+		__free_one_page(zone, arena, page, order);
+	}
+	if(locked){
+		arena_unlock(locked);
+	}
+	zone_clear_pressure(zone);
+}
+
+void rte_free_pages_bulk(struct rte_page **pages, unsigned int n)
+{
+	unsigned int i;
+
+	if(unlikely(rte_trace_enabled)){
+		for(i=0; i<n; i++){
+			rte_trace_event(RTE_TRACE_FREE_PAGES, rte_page_to_virt(pages[i]), 0, 0);
+		}
+	}
+	__rte_free_pages_bulk(pages, n);
+}
+
+/*
+ * 分配nr_pages个连续的页(不要求是2的幂)。
+ * 先分配能容纳nr_pages的最小的块，再把多余的尾部页立即归还给Buddy系统。
+ * 首页标记PG_exact，页数记录在首页的private中；其余页标记为tail，
+ * 因此rte_virt_to_head_page()对其中任一地址都返回首页。
+ * */
+static struct rte_page *__rte_get_pages_exact(unsigned int nr_pages)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+	struct rte_buddy_arena *arena;
+	struct rte_page *page;
+	unsigned int order=0;
+	unsigned int i;
+
+	if(unlikely(!nr_pages || nr_pages>(1U<<(RTE_MAX_ORDER-1)))){
+		RTE_BUDDY_BUG(__FILE__, __LINE__);
+		return NULL;
+	}
+	while((1U<<order)<nr_pages){
+		order++;
+	}
+
+	page = __rte_get_pages(order, 0);
+	if(NULL==page){
+		return NULL;
+	}
+	arena = page_arena(zone, page);
+	arena_lock(arena);
+	if(PageCompound(page)){
+		destroy_compound_page(page, order);
+	}
+	if(nr_pages<(1U<<order)){
+		__free_pages_range(zone, arena, page+nr_pages, (1U<<order)-nr_pages);
+	}
+	arena_unlock(arena);
+	if(page_tag(page)){ // 只保留nr_pages个页的计数
+		rte_tag_uncharge(page_tag(page), (1U<<order)-nr_pages);
+	}
+
+	__SetPageExact(page);
+	set_page_private(page, nr_pages);
+	for(i=1; i<nr_pages; i++){
+		__SetPageTail(page+i);
+		page[i].first_page = page;
+	}
+	return page;
+}
+
+struct rte_page *rte_get_pages_exact(unsigned int nr_pages)
+{
+	struct rte_page *page = __rte_get_pages_exact(nr_pages);
+
+	rte_trace_event(RTE_TRACE_GET_PAGES_EXACT, page ? rte_page_to_virt(page) : NULL, nr_pages, 0);
+	rte_tag_soft_notify();
+	return page;
+}
+
+static void __rte_free_pages_exact(struct rte_page *page)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+	struct rte_buddy_arena *arena = page_arena(zone, page);
+	unsigned int nr_pages;
+	unsigned int i;
+
+	if(unlikely(!PageExact(page))){
+		RTE_BUDDY_BUG(__FILE__, __LINE__);
+		return;
+	}
+	nr_pages = page_private(page);
+	if(page_tag(page)){
+		rte_tag_uncharge(page_tag(page), nr_pages);
+		set_page_tag(page, 0);
+	}
+	__ClearPageExact(page);
+	set_page_private(page, 0);
+	for(i=1; i<nr_pages; i++){
+		__ClearPageTail(page+i);
+	}
+
+	arena_lock(arena);
+	__free_pages_range(zone, arena, page, nr_pages);
+	arena_unlock(arena);
+	zone_clear_pressure(zone);
+}
+
+void rte_free_pages_exact(struct rte_page *page)
+{
+	rte_trace_event(RTE_TRACE_FREE_PAGES_EXACT, rte_page_to_virt(page), 0, 0);
+	__rte_free_pages_exact(page);
+}
+
 /*
  * 初始化Buddy系统
  * 参数
@@ -206,35 +880,131 @@ int rte_buddy_system_init(struct rte_mem_zone *zone, unsigned long start_addr,
 						  struct rte_page *start_page, unsigned int page_num)
 {
 	struct rte_page *page=NULL;
-	unsigned int i;
-	struct free_area *area=NULL;;
+	unsigned int i, j, k;
+	unsigned int block_num, block_per_arena;
+	struct rte_buddy_arena *arena=NULL;
+	struct free_area *area=NULL;
 
 	global_mem_zone = zone;
 
 	// Init mem zone	
-	rte_spinlock_init(&zone->lock);
-	for(i=0; i<RTE_MAX_ORDER; i++){
-		area = zone->free_area + i;
-		INIT_LIST_HEAD(&area->free_list);
-		area->nr_free = 0;
-	}
 	zone->page_num = page_num;
 	zone->page_size = RTE_PAGE_SIZE;
 	zone->first_page = start_page;
 	zone->start_addr = start_addr;
 	zone->end_addr = zone->start_addr + (page_num * RTE_PAGE_SIZE);
+	/* 默认保留1/64的页给紧急分配，low/high与Linux Kernel一样为min的5/4与3/2 */
+	zone->watermark[WMARK_MIN] = page_num>>6;
+	zone->watermark[WMARK_LOW] = zone->watermark[WMARK_MIN] + (zone->watermark[WMARK_MIN]>>2);
+	zone->watermark[WMARK_HIGH] = zone->watermark[WMARK_MIN] + (zone->watermark[WMARK_MIN]>>1);
+	zone->pressure = 0;
+	zone->phys_table = NULL;
+	zone->phys_shift = 0;
+
+	/* 以最大块为单位把zone均分给各个arena, 末尾不足一个最大块的页归最后一个arena */
+	block_num = page_num>>(RTE_MAX_ORDER-1);
+	zone->arena_num = RTE_BUDDY_ARENA_NUM;
+	if(zone->arena_num>block_num){
+		zone->arena_num = block_num ? block_num : 1;
+	}
+	block_per_arena = block_num/zone->arena_num;
+	if(!block_per_arena){
+		block_per_arena = 1;
+	}
+
+	for(i=0; i<zone->arena_num; i++){
+		arena = zone->arena + i;
+		rte_lock_init(RTE_ZONE_LOCK, &arena->lock);
+		arena->free_zero_num = 0;
+		arena->nr_block_steal = 0;
+		arena->nr_fallback = 0;
+		for(j=0; j<RTE_MAX_ORDER; j++){
+			area = arena->free_area + j;
+			for(k=0; k<RTE_MIGRATE_TYPES; k++){
+				INIT_LIST_HEAD(&area->free_list[k]);
+			}
+			area->nr_free = 0;
+		}
+	}
 
+	/*
+	 * 先初始化所有的页描述符再逐个释放: 释放时会检查后面的buddy页，
+	 * 页描述符所在的内存可能不是0(如重新初始化的持久内存池)
+	 * */
 	for(i=0; i<page_num; i++){
+		unsigned int id = (i>>(RTE_MAX_ORDER-1))/block_per_arena;
 		page = zone->first_page + i;
 		memset(page, 0, sizeof(struct rte_page));
 		INIT_LIST_HEAD(&page->lru);
 		rte_spinlock_init(&page->lock);
-		rte_free_pages(page);
+		set_page_zone_id(page, id<zone->arena_num ? id : zone->arena_num-1);
+	}
+	for(i=0; i<page_num; i++){
+		__rte_free_pages(zone->first_page + i);
 	}
 
 	return 0;
 }
 
+/*
+ * 重新使用上一个进程在持久内存池中留下的zone，不修改页与空闲链表。
+ * 只重置与进程相关的状态: 锁、物理地址表(指向上一个进程的内存)与压力状态。
+ * tag的计数从0开始，因此清除页上记录的tag，上一个进程留下的块释放时不再扣除
+ * */
+int rte_buddy_system_attach(struct rte_mem_zone *zone)
+{
+	unsigned int i;
+
+	if(!zone->page_num||!zone->arena_num||zone->arena_num>RTE_BUDDY_ARENA_NUM){
+		return -1;
+	}
+	for(i=0; i<zone->arena_num; i++){
+		rte_lock_init(RTE_ZONE_LOCK, &zone->arena[i].lock);
+	}
+	for(i=0; i<zone->page_num; i++){
+		set_page_tag(zone->first_page + i, 0);
+	}
+	zone->phys_table = NULL;
+	zone->pressure = 0;
+	global_mem_zone = zone;
+	return 0;
+}
+
+/*
+ * 记录zone中每个物理段的起始物理地址，段大小为(1<<phys_shift)字节，
+ * 段的虚拟地址从zone->start_addr开始连续排列。phys_table由调用者提供
+ * */
+int rte_zone_set_phys(uint64_t *phys_table, uint32_t phys_shift)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+
+	if(phys_shift<RTE_PAGE_SHIFT){
+		return -1;
+	}
+	zone->phys_shift = phys_shift;
+	zone->phys_table = phys_table;
+	return 0;
+}
+
+/* O(1)地查找zone中任意地址的物理地址 */
+uint64_t rte_mem_virt2phy(const void *ptr)
+{
+	struct rte_mem_zone *zone = global_mem_zone;
+	uint64_t address = (uint64_t)ptr;
+	uint64_t offset;
+
+	if(NULL==zone->phys_table||address<zone->start_addr||address>=zone->end_addr){
+		return RTE_BAD_PHYS_ADDR;
+	}
+	offset = address - zone->start_addr;
+	return zone->phys_table[offset>>zone->phys_shift] + (offset&((1UL<<zone->phys_shift)-1));
+}
+
+uint64_t rte_page_to_phys(struct rte_page *page)
+{
+	return rte_mem_virt2phy(rte_page_to_virt(page));
+}
+
 void *rte_page_to_virt(struct rte_page *page)
 {
 	uint64_t page_idx=0;
@@ -3,11 +3,17 @@
 #include "rte_types.h"
 #include "rte_list.h"
 #include "rte_spinlock.h"
+#include "rte_lcore.h"
 
 #define RTE_MAX_ORDER 7U // Max = (1<<order)*PAGE_SIZE
 #define RTE_PAGE_SIZE 	0x1000U	// Buddy系统中每页的大小
 #define RTE_PAGE_SHIFT	12U  // 与上面的RTE_PAGE_SIZE对应 
 
+/* Buddy arena->lock所用锁的类型: spinlock, ticketlock或mcslock */
+#ifndef RTE_ZONE_LOCK
+#define RTE_ZONE_LOCK spinlock
+#endif
+
 /*
  * 标记Page所处的状态
  * */
@@ -17,6 +23,9 @@ enum pageflags{
 	PG_head, // 
 	PG_tail, //
 	PG_buddy, // Page在Buddy系统中
+	PG_exact, // 由rte_get_pages_exact()分配的首页
+	PG_sampled, // Slab中有被rte_prof采样的Obj
+	PG_slub_bitmap, // Slab的空闲Obj记录在page->free_map中，见RTE_SLAB_BITMAP
 };
 
 /*
@@ -36,26 +45,86 @@ struct rte_page{
 		struct rte_mem_cache *slab;
 		struct rte_page *first_page;
 	};
-	void *freelist; // 
+	union{
+		void *freelist; // 
+		uint64_t free_map; // 位图格式的slab中空闲Obj的位图，第i位对应第i个Obj
+	};
+	void *bump; // Slab中尚未被分配过的Obj的起始地址，NULL表示已全部分配过
 }; 
 
+/*
+ * 防碎片分组(与Linux Kernel的migratetype相同的做法)：zone按最大块划分为pageblock，
+ * 每个pageblock有一个分配类型，空闲页按所在pageblock的类型放入不同的链表。
+ * Slab的页长期存活且分散，与其他分配分开后，零散的Slab页不会阻碍其他类型的高阶分配。
+ * 某类型没有空闲页时，优先把其他类型的整个空闲pageblock改为本类型。
+ * 编译时定义RTE_BUDDY_NO_GROUPING则所有分配都使用同一类型
+ * */
+enum rte_migratetype{
+	RTE_MIGRATE_LARGE, // 大块或短期的分配(默认)
+	RTE_MIGRATE_SLAB, // Slab使用的页
+	RTE_MIGRATE_TYPES
+};
+#define RTE_PAGE_MIGRATE_SHIFT 48 // pageblock的类型记录在块首页page->flags的48-55位
+#define RTE_PAGE_MIGRATE_MASK 0xffUL
+
 struct free_area{
-	struct list_head free_list;
-	uint32_t nr_free;
+	struct list_head free_list[RTE_MIGRATE_TYPES];
+	uint32_t nr_free; // 各类型的空闲块个数之和
 };
 
+/*
+ * zone被划分为的Buddy arena的个数。每个arena有独立的空闲页链表和锁，
+ * Core优先从自己的arena中分配，arena为空时才从其他arena中窃取最大块。
+ * 取值为1时即为不分片的Buddy系统。
+ * */
+#ifndef RTE_BUDDY_ARENA_NUM
+#define RTE_BUDDY_ARENA_NUM 1
+#endif
+#define RTE_PAGE_ARENA_SHIFT 56 // page->flags的高8位记录页所属的arena
+#define RTE_PAGE_TAG_SHIFT 40 // 已分配块的首页page->flags的40-47位记录块所属的tag(见rte_tag.h)
+#define RTE_PAGE_TAG_MASK 0xffUL
+#define RTE_PAGE_COLOR_SHIFT 32 // slab首页page->flags的32-39位记录slab的颜色(见rte_slub.h)
+#define RTE_PAGE_COLOR_MASK 0xffUL
+
+/* 分配标志 */
+#define RTE_GFP_CRITICAL 0x1U // 紧急分配，可以使用min水位以下的保留页
+#define RTE_GFP_CONTIG 0x2U // 分配的块在物理上必须连续
+#define RTE_GFP_SLAB 0x4U // 页用于Slab，从RTE_MIGRATE_SLAB类型的pageblock中分配
+
+#define RTE_BAD_PHYS_ADDR ((uint64_t)-1)
+
+enum zone_watermarks{
+	WMARK_MIN, // 空闲页低于此值时，只有紧急分配能够成功
+	WMARK_LOW, // 空闲页低于此值时，调用注册的内存压力回调
+	WMARK_HIGH, // 空闲页回到此值以上时，解除内存压力状态
+	NR_WMARK
+};
+
+typedef void (*rte_pressure_cb_t)(void *arg, uint32_t free_pages);
+
+struct rte_buddy_arena{
+	RTE_LOCK_T(RTE_ZONE_LOCK) lock;
+	uint32_t free_zero_num; // arena中空闲页的个数
+	uint64_t nr_block_steal; // 把其他类型的空闲pageblock改为所需类型的次数
+	uint64_t nr_fallback; // 只能从其他类型的pageblock中分配的次数，会使pageblock混杂
+	struct free_area free_area[RTE_MAX_ORDER]; // 空闲页链表
+}__attribute__((aligned(64)));
+
 /*
  * 要被Buddy系统管理的大块内存的描述符
  * */
 struct rte_mem_zone{
 	uint32_t page_num; // 内存块中页的个数
 	uint32_t page_size; // 每个页的大小
-	uint32_t free_zero_num;
+	uint32_t arena_num; // 实际使用的arena个数
+	uint64_t *phys_table; // 每个物理段(如hugepage)的起始物理地址，NULL表示未知
+	uint32_t phys_shift; // 物理段大小的位数
+	uint32_t watermark[NR_WMARK];
+	volatile int pressure; // 空闲页低于low水位后置1，回到high水位以上后清0
 	struct rte_page *first_page;
 	uint64_t start_addr; // 内存块起始地址
 	uint64_t end_addr; // 内存块结束地址
-	struct free_area free_area[RTE_MAX_ORDER]; // 空闲页链表
-	rte_spinlock_t lock;
+	struct rte_buddy_arena arena[RTE_BUDDY_ARENA_NUM];
 };
 
 static inline void RTE_BUDDY_BUG(char *f, int line)
@@ -93,6 +162,36 @@ static inline void __SetPageSlubFrozen(struct rte_page *page)
 	page->flags |= (1UL<<PG_slub_frozen);	
 }
 
+static inline void __SetPageExact(struct rte_page *page)
+{
+	page->flags |= (1UL<<PG_exact);
+}
+
+static inline void __ClearPageExact(struct rte_page *page)
+{
+	page->flags &= ~(1UL<<PG_exact);
+}
+
+static inline void __SetPageSampled(struct rte_page *page)
+{
+	page->flags |= (1UL<<PG_sampled);
+}
+
+static inline void __ClearPageSampled(struct rte_page *page)
+{
+	page->flags &= ~(1UL<<PG_sampled);
+}
+
+static inline void __SetPageSlubBitmap(struct rte_page *page)
+{
+	page->flags |= (1UL<<PG_slub_bitmap);
+}
+
+static inline void __ClearPageSlubBitmap(struct rte_page *page)
+{
+	page->flags &= ~(1UL<<PG_slub_bitmap);
+}
+
 static inline void __ClearPageBuddy(struct rte_page *page)
 {
 	page->flags &= ~(1UL<<PG_buddy);
@@ -138,6 +237,21 @@ static inline int PageSlub(struct rte_page *page)
 	return (page->flags & (1UL<<PG_slub));
 }
 
+static inline int PageExact(struct rte_page *page)
+{
+	return (page->flags & (1UL<<PG_exact));
+}
+
+static inline int PageSampled(struct rte_page *page)
+{
+	return (page->flags & (1UL<<PG_sampled));
+}
+
+static inline int PageSlubBitmap(struct rte_page *page)
+{
+	return (page->flags & (1UL<<PG_slub_bitmap));
+}
+
 static inline int PageCompound(struct rte_page *page)
 {
 	return (page->flags & ((1UL<<PG_head)|(1UL<<PG_tail)));
@@ -155,12 +269,32 @@ static inline int compound_order(struct rte_page *page)
 	return (unsigned long)page[1].lru.prev;
 }
 
+/* 本线程最近一次从Buddy系统分配页时分裂的层数，0表示没有分裂 */
+extern __thread unsigned int rte_buddy_split;
+
 int rte_buddy_system_init(struct rte_mem_zone *zone, unsigned long start_addr, 
 						  struct rte_page *start_page, unsigned int page_num);
+int rte_buddy_system_attach(struct rte_mem_zone *zone);
+struct rte_page *__rte_get_pages(unsigned int order, unsigned int flags);
 struct rte_page *rte_get_pages(unsigned int order);
+void __rte_free_pages(struct rte_page *page);
 void rte_free_pages(struct rte_page *page);
+unsigned int __rte_get_pages_bulk(unsigned int order, unsigned int n, struct rte_page **pages,
+				unsigned int flags);
+unsigned int rte_get_pages_bulk(unsigned int order, unsigned int n, struct rte_page **pages);
+void __rte_free_pages_bulk(struct rte_page **pages, unsigned int n);
+void rte_free_pages_bulk(struct rte_page **pages, unsigned int n);
+struct rte_page *rte_get_pages_exact(unsigned int nr_pages);
+void rte_free_pages_exact(struct rte_page *page);
 void *rte_page_to_virt(struct rte_page *page);
 struct rte_page *rte_virt_to_head_page(void *ptr);
+struct rte_mem_zone *rte_buddy_zone(void);
+uint32_t rte_zone_free_pages(void);
+int rte_zone_set_phys(uint64_t *phys_table, uint32_t phys_shift);
+uint64_t rte_mem_virt2phy(const void *ptr);
+uint64_t rte_page_to_phys(struct rte_page *page);
+int rte_zone_set_watermarks(uint32_t min, uint32_t low, uint32_t high);
+int rte_register_pressure_cb(rte_pressure_cb_t cb, void *arg);
 
 #endif
 
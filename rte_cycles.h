@@ -0,0 +1,13 @@
+#ifndef __RTE_CYCLES_H__
+#define __RTE_CYCLES_H__
+#include "rte_types.h"
+
+/* 读取TSC计数器, Only for x86_64 */
+static inline uint64_t rte_rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi<<32)|lo;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __RTE_LATENCY_H__
+#define __RTE_LATENCY_H__
+#include "rte_types.h"
+
+/*
+ * 对数分桶的延迟直方图(HDR风格)，单位为TSC周期。
+ * 每个2的幂区间再均分为(1<<RTE_LAT_SUB_BITS)个子桶，相对误差不超过1/(1<<RTE_LAT_SUB_BITS)，
+ * 小于(1<<RTE_LAT_SUB_BITS)的值各占一个桶，超过范围的值计入最后一个桶。
+ * 直方图只由所属Core写入，不使用原子操作，读取时再把各Core的直方图相加
+ * */
+#define RTE_LAT_SUB_BITS 2
+#define RTE_LAT_SUB_NUM (1U<<RTE_LAT_SUB_BITS)
+#define RTE_LAT_MAX_SHIFT 32
+#define RTE_LAT_BUCKETS ((RTE_LAT_MAX_SHIFT-RTE_LAT_SUB_BITS+1)*RTE_LAT_SUB_NUM)
+
+/* 分配器中被统计的路径 */
+enum rte_lat_path{
+	RTE_LAT_FAST, // 从Local slab的freelist或bump指针分配
+	RTE_LAT_PARTIAL, // 从当前页或partial链表重新装载Local slab
+	RTE_LAT_NEW_SLAB, // 从Buddy系统分配新slab，没有分裂更大的块
+	RTE_LAT_BUDDY_SPLIT, // 从Buddy系统分配新slab，且分裂了更大的块
+	RTE_LAT_REMOTE_FREE, // 释放的Obj不属于当前Core的Local slab
+	RTE_LAT_PATH_NUM
+};
+
+struct rte_lat_hist{
+	uint64_t count[RTE_LAT_BUCKETS];
+};
+
+static inline unsigned int rte_lat_index(uint64_t cycles)
+{
+	unsigned int msb;
+
+	if(cycles<RTE_LAT_SUB_NUM){
+		return cycles;
+	}
+	msb = 63 - __builtin_clzll(cycles);
+	if(msb>=RTE_LAT_MAX_SHIFT){
+		return RTE_LAT_BUCKETS-1;
+	}
+	return ((msb-RTE_LAT_SUB_BITS+1)<<RTE_LAT_SUB_BITS) +
+		((cycles>>(msb-RTE_LAT_SUB_BITS))&(RTE_LAT_SUB_NUM-1));
+}
+
+/* 桶的下界 */
+static inline uint64_t rte_lat_value(unsigned int index)
+{
+	unsigned int msb;
+
+	if(index<RTE_LAT_SUB_NUM){
+		return index;
+	}
+	msb = (index>>RTE_LAT_SUB_BITS) + RTE_LAT_SUB_BITS - 1;
+	return (uint64_t)(RTE_LAT_SUB_NUM|(index&(RTE_LAT_SUB_NUM-1))) << (msb-RTE_LAT_SUB_BITS);
+}
+
+static inline void rte_lat_record(struct rte_lat_hist *h, uint64_t cycles)
+{
+	h->count[rte_lat_index(cycles)]++;
+}
+
+static inline uint64_t rte_lat_total(const struct rte_lat_hist *h)
+{
+	uint64_t total=0;
+	unsigned int i;
+
+	for(i=0;i<RTE_LAT_BUCKETS;i++){
+		total += h->count[i];
+	}
+	return total;
+}
+
+/* 返回第permille‰个样本所在桶的下界, 例如permille为990时得到p99 */
+static inline uint64_t rte_lat_percentile(const struct rte_lat_hist *h, unsigned int permille)
+{
+	uint64_t total = rte_lat_total(h);
+	uint64_t rank, sum=0;
+	unsigned int i;
+
+	if(!total){
+		return 0;
+	}
+	rank = (total*permille + 999)/1000;
+	for(i=0;i<RTE_LAT_BUCKETS;i++){
+		sum += h->count[i];
+		if(sum>=rank){
+			return rte_lat_value(i);
+		}
+	}
+	return rte_lat_value(RTE_LAT_BUCKETS-1);
+}
+
+#endif
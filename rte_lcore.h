@@ -0,0 +1,20 @@
+#ifndef __RTE_LCORE_H__
+#define __RTE_LCORE_H__
+
+#define RTE_MAX_CPU_NUM 8
+
+/* 当前线程所在Core的序号，由使用者在每个线程中通过rte_set_self_id()设置 */
+extern __thread int rte_self_id;
+
+/* 返回所在Core的序号。用于访问为每个Core都准备的本地缓存 */
+static inline int rte_get_self_id(void)
+{
+	return rte_self_id;
+}
+
+static inline void rte_set_self_id(int id)
+{
+	rte_self_id = id;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include "rte_slub.h"
+#include "rte_maint.h"
+#include "rte_stats.h"
+#include "rte_trace.h"
+
+static pthread_t maint_tid;
+static volatile int maint_running;
+static unsigned int maint_period_ms;
+static int membarrier_cmd;
+
+static int rte_membarrier(int cmd)
+{
+	return syscall(__NR_membarrier, cmd, 0);
+}
+
+/* 使所有线程都执行一次内存屏障，Local slab的所在Core因此不需要原子操作 */
+static void maint_barrier(void)
+{
+	rte_membarrier(membarrier_cmd);
+}
+
+/* 优先使用开销较小的PRIVATE_EXPEDITED，内核不支持时退回GLOBAL */
+static int maint_barrier_init(void)
+{
+	int cmds = rte_membarrier(MEMBARRIER_CMD_QUERY);
+
+	if(cmds<0){
+		return -1;
+	}
+	if((cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+	   !rte_membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED)){
+		membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+		return 0;
+	}
+	if(cmds & MEMBARRIER_CMD_GLOBAL){
+		membarrier_cmd = MEMBARRIER_CMD_GLOBAL;
+		return 0;
+	}
+	return -1;
+}
+
+static void *maint_thread_main(void *arg)
+{
+	void (*barrier)(void) = arg;
+	struct timespec ts;
+
+	ts.tv_sec = maint_period_ms/1000;
+	ts.tv_nsec = (maint_period_ms%1000)*1000000L;
+	while(maint_running){
+		nanosleep(&ts, NULL);
+		if(!maint_running){
+			break;
+		}
+		rte_slub_maintain(barrier);
+		rte_stats_update();
+		rte_trace_flush();
+	}
+	return NULL;
+}
+
+int rte_maint_start(unsigned int period_ms)
+{
+	void (*barrier)(void) = maint_barrier;
+
+	if(maint_running||!period_ms){
+		return -1;
+	}
+	if(maint_barrier_init()<0){
+		printf("membarrier is not supported, idle cpu slabs will not be flushed.\n");
+		barrier = NULL;
+	}
+	maint_period_ms = period_ms;
+	maint_running = 1;
+	if(pthread_create(&maint_tid, NULL, maint_thread_main, barrier)){
+		maint_running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void rte_maint_stop(void)
+{
+	if(!maint_running){
+		return;
+	}
+	maint_running = 0;
+	pthread_join(maint_tid, NULL);
+}
@@ -0,0 +1,13 @@
+#ifndef __RTE_MAINT_H__
+#define __RTE_MAINT_H__
+
+/*
+ * 后台维护线程，每period_ms毫秒执行一次rte_slub_maintain():
+ * 清空空闲Core的Local slab，释放partial链表中多余的空slab，调整各cache的参数，
+ * 并更新rte_stats_init()创建的共享内存状态，把rte_trace的缓冲区写入文件。
+ * 分配与释放的路径上不做这些工作。
+ * */
+int rte_maint_start(unsigned int period_ms);
+void rte_maint_stop(void);
+
+#endif
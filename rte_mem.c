@@ -1,14 +1,357 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 #include "rte_slub.h"
+#include "rte_mem.h"
+#include "rte_pool.h"
+#include "rte_trace.h"
+#include "rte_tag.h"
+
+#define RTE_HUGETLBFS_DIR "/dev/hugepages"
+#define RTE_HUGETLBFS_FILE "%s/.rte_pool_file" // 持久模式使用固定的文件名
+#define RTE_THP_SIZE (1UL<<21)
+#define RTE_PREFAULT_MAX_THREADS 64
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+/*
+ * 后备存储。map()返回映射的地址，失败时返回MAP_FAILED；
+ * mmap_flags中包含MAP_FIXED_NOREPLACE与MAP_POPULATE等由rte_mem_init()决定的标志
+ * */
+struct rte_mem_backend_ops{
+	const char *name;
+	int huge; // 是否使用大页，决定映射大小的粒度与是否记录物理地址
+	void *(*map)(const struct rte_mem_config *cfg, size_t size, int mmap_flags);
+};
+
+static void *mem_addr;
+static size_t mem_size;
+static uint64_t *mem_phys;
+
+static void *hugetlbfs_map(const struct rte_mem_config *cfg, size_t size, int mmap_flags)
+{
+	const char *dir = cfg->hugetlbfs_dir ? cfg->hugetlbfs_dir : RTE_HUGETLBFS_DIR;
+	char path[256];
+	struct statfs sfs;
+	struct stat st;
+	void *addr;
+	int fd;
+
+	if(statfs(dir, &sfs)<0){
+		perror(dir);
+		return MAP_FAILED;
+	}
+	if(sfs.f_type!=HUGETLBFS_MAGIC){
+		printf("rte_mem: %s is not a hugetlbfs mount, using normal pages.\n", dir);
+	}else if((unsigned long)sfs.f_bsize!=(1UL<<cfg->huge_shift)){
+		printf("rte_mem: huge page size of %s is %ld, not %lu.\n", dir, (long)sfs.f_bsize,
+				1UL<<cfg->huge_shift);
+		return MAP_FAILED;
+	}
+	if(cfg->persistent){
+		snprintf(path, sizeof(path), RTE_HUGETLBFS_FILE, dir);
+	}else{
+		snprintf(path, sizeof(path), RTE_HUGETLBFS_FILE ".%d", dir, getpid());
+	}
+	fd = open(path, O_CREAT|O_RDWR|(cfg->persistent ? 0 : O_TRUNC), 0600);
+	if(fd<0){
+		perror(path);
+		return MAP_FAILED;
+	}
+	if(fstat(fd, &st)<0||((size_t)st.st_size!=size && ftruncate(fd, size)<0)){
+		close(fd);
+		return MAP_FAILED;
+	}
+	addr = mmap((void *)cfg->addr, size, PROT_READ|PROT_WRITE, MAP_SHARED|mmap_flags, fd, 0);
+	close(fd);
+	if(!cfg->persistent){ // 映射解除后大页即归还给系统
+		unlink(path);
+	}
+	return addr;
+}
+
+static void *anon_hugetlb_map(const struct rte_mem_config *cfg, size_t size, int mmap_flags)
+{
+	return mmap((void *)cfg->addr, size, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(cfg->huge_shift<<MAP_HUGE_SHIFT)|mmap_flags, -1, 0);
+}
+
+/* 透明大页要求地址按2MB对齐，未指定地址时多映射2MB再截去两端 */
+static void *thp_map(const struct rte_mem_config *cfg, size_t size, int mmap_flags)
+{
+	unsigned long start, aligned;
+	void *addr;
+
+	if(cfg->addr){
+		addr = mmap((void *)cfg->addr, size, PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS|mmap_flags, -1, 0);
+	}else{
+		addr = mmap(NULL, size+RTE_THP_SIZE, PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS|mmap_flags, -1, 0);
+		if(addr!=MAP_FAILED){
+			start = (unsigned long)addr;
+			aligned = (start+RTE_THP_SIZE-1)&~(RTE_THP_SIZE-1);
+			if(aligned>start){
+				munmap(addr, aligned-start);
+			}
+			munmap((void *)(aligned+size), start+RTE_THP_SIZE-aligned);
+			addr = (void *)aligned;
+		}
+	}
+	if(addr!=MAP_FAILED && madvise(addr, size, MADV_HUGEPAGE)<0){
+		printf("rte_mem: transparent huge pages are not available.\n");
+	}
+	return addr;
+}
+
+static void *normal_map(const struct rte_mem_config *cfg, size_t size, int mmap_flags)
+{
+	return mmap((void *)cfg->addr, size, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|mmap_flags, -1, 0);
+}
+
+static const struct rte_mem_backend_ops mem_backends[RTE_MEM_BACKEND_NUM] = {
+	[RTE_MEM_HUGETLBFS] = {"hugetlbfs", 1, hugetlbfs_map},
+	[RTE_MEM_ANON_HUGETLB] = {"anon-hugetlb", 1, anon_hugetlb_map},
+	[RTE_MEM_THP] = {"thp", 0, thp_map},
+	[RTE_MEM_4K] = {"4k", 0, normal_map},
+};
+
+struct prefault_arg{
+	pthread_t tid;
+	int created;
+	volatile char *start;
+	volatile char *end;
+	size_t step;
+};
+
+/* 读出再写回每页的第一个字节: 触发写缺页，且不破坏持久内存池中的数据 */
+static void *prefault_main(void *arg)
+{
+	struct prefault_arg *a = arg;
+	volatile char *p;
+
+	for(p=a->start; p<a->end; p+=a->step){
+		*p = *p;
+	}
+	return NULL;
+}
+
+static void mem_prefault(void *addr, size_t size, size_t step, int threads)
+{
+	struct prefault_arg args[RTE_PREFAULT_MAX_THREADS];
+	size_t chunk;
+	int i, n=0;
+
+	if(threads<1){
+		threads = 1;
+	}
+	if(threads>RTE_PREFAULT_MAX_THREADS){
+		threads = RTE_PREFAULT_MAX_THREADS;
+	}
+	chunk = (size/step+threads-1)/threads*step;
+	for(i=0;i<threads&&(size_t)i*chunk<size;i++){
+		args[i].start = (char *)addr + (size_t)i*chunk;
+		args[i].end = (char *)addr + ((size_t)(i+1)*chunk<size ? (size_t)(i+1)*chunk : size);
+		args[i].step = step;
+		args[i].created = i && !pthread_create(&args[i].tid, NULL, prefault_main, &args[i]);
+		n = i+1;
+	}
+	for(i=0;i<n;i++){ // 第一段以及创建线程失败的段由当前线程完成
+		if(!args[i].created){
+			prefault_main(&args[i]);
+		}
+	}
+	for(i=0;i<n;i++){
+		if(args[i].created){
+			pthread_join(args[i].tid, NULL);
+		}
+	}
+}
+
+/* 通过/proc/self/pagemap查找虚拟地址对应的物理地址(需要CAP_SYS_ADMIN) */
+static uint64_t pagemap_virt2phy(void *virtaddr)
+{
+	uint64_t entry;
+	uint64_t pfn;
+	long page_size = sysconf(_SC_PAGESIZE);
+	off_t offset = ((unsigned long)virtaddr/page_size)*sizeof(uint64_t);
+	int fd;
+
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	if(fd<0){
+		return RTE_BAD_PHYS_ADDR;
+	}
+	if(pread(fd, &entry, sizeof(entry), offset)!=sizeof(entry)){
+		close(fd);
+		return RTE_BAD_PHYS_ADDR;
+	}
+	close(fd);
+
+	pfn = entry & ((1UL<<55)-1); // bit 0-54: page frame number
+	if(!(entry&(1UL<<63))||!pfn){ // 页不在内存中，或没有权限读取PFN
+		return RTE_BAD_PHYS_ADDR;
+	}
+	return pfn*page_size + ((unsigned long)virtaddr%page_size);
+}
+
+/* 记录每个大页的物理地址，供rte_mem_virt2phy()查找。大页尚未分配或没有权限时不记录 */
+static void mem_phys_init(void *addr, size_t size, uint32_t shift)
+{
+	size_t i, num = size>>shift;
+
+	mem_phys = malloc(num*sizeof(uint64_t));
+	if(NULL==mem_phys){
+		return;
+	}
+	for(i=0;i<num;i++){
+		mem_phys[i] = pagemap_virt2phy((char *)addr + (i<<shift));
+		if(mem_phys[i]==RTE_BAD_PHYS_ADDR){
+			free(mem_phys);
+			mem_phys = NULL;
+			return;
+		}
+	}
+	rte_zone_set_phys(mem_phys, shift);
+}
+
+/*
+ * 按cfg映射内存池并初始化Buddy与Slub系统，元数据放在映射的末尾(见rte_pool.h)。
+ * 返回RTE_POOL_NEW，或持久模式下重新使用了上一个进程的内存池时返回RTE_POOL_ATTACHED，失败时返回-1
+ * */
+int rte_mem_init(const struct rte_mem_config *config)
+{
+	struct rte_mem_config cfg = *config;
+	const struct rte_mem_backend_ops *ops;
+	size_t unit, size;
+	int mmap_flags=0;
+	void *addr;
+	int ret;
+
+	if(mem_addr||cfg.backend<0||cfg.backend>=RTE_MEM_BACKEND_NUM){
+		return -1;
+	}
+	ops = mem_backends + cfg.backend;
+	if(!cfg.huge_shift){
+		cfg.huge_shift = 21;
+	}
+	if(cfg.persistent && (cfg.backend!=RTE_MEM_HUGETLBFS||!cfg.addr)){
+		printf("rte_mem: persistent pools need the hugetlbfs backend and a fixed address.\n");
+		return -1;
+	}
+	if(ops->huge){
+		unit = 1UL<<cfg.huge_shift;
+	}else if(cfg.backend==RTE_MEM_THP){
+		unit = RTE_THP_SIZE;
+	}else{
+		unit = RTE_PAGE_SIZE;
+	}
+	size = (cfg.size+unit-1)&~(unit-1);
+	if(cfg.addr & (unit-1)){
+		return -1;
+	}
+	if(cfg.addr){
+#ifdef MAP_FIXED_NOREPLACE
+		mmap_flags |= MAP_FIXED_NOREPLACE;
+#else
+		mmap_flags |= MAP_FIXED;
+#endif
+	}
+	if(cfg.prefault==RTE_PREFAULT_POPULATE && cfg.backend!=RTE_MEM_THP){ // THP需要先madvise再触发缺页
+		mmap_flags |= MAP_POPULATE;
+	}
+
+	addr = ops->map(&cfg, size, mmap_flags);
+	if(addr==MAP_FAILED){
+		printf("rte_mem: failed to map %lu bytes with the %s backend.\n", size, ops->name);
+		return -1;
+	}
+	if(cfg.addr && (unsigned long)addr!=cfg.addr){ // 旧内核不支持MAP_FIXED_NOREPLACE时把地址当作提示
+		munmap(addr, size);
+		return -1;
+	}
+	if(cfg.prefault==RTE_PREFAULT_THREADS){
+		mem_prefault(addr, size, unit, cfg.prefault_threads);
+	}else if(cfg.prefault==RTE_PREFAULT_POPULATE && cfg.backend==RTE_MEM_THP){
+		mem_prefault(addr, size, unit, 1);
+	}
+
+	ret = rte_pool_setup(addr, size, cfg.persistent);
+	if(ret<0){
+		munmap(addr, size);
+		return -1;
+	}
+	mem_addr = addr;
+	mem_size = size;
+	if(ops->huge){
+		mem_phys_init(addr, size, cfg.huge_shift);
+	}
+	/* 重新使用的持久内存池已经是热的 */
+	if(ret==RTE_POOL_NEW && cfg.reserve_num>0 &&
+	   rte_slub_prewarm(cfg.reserve, cfg.reserve_num, cfg.prime_cores)<0){
+		printf("rte_mem: failed to reserve slab objects.\n");
+		rte_mem_exit();
+		return -1;
+	}
+	return ret;
+}
+
+/* 解除内存池的映射。持久模式下标记内存池已正常关闭 */
+void rte_mem_exit(void)
+{
+	if(NULL==mem_addr){
+		return;
+	}
+	rte_pool_release();
+	munmap(mem_addr, mem_size);
+	free(mem_phys);
+	mem_phys = NULL;
+	mem_addr = NULL;
+}
 
 void  *rte_malloc(int size)
 {
 	void *ptr=NULL;
-	ptr = __rte_slub_alloc(size);
+	ptr = __rte_slub_alloc(size, 0);
+	rte_trace_event(RTE_TRACE_MALLOC, ptr, size, 0);
+	rte_tag_soft_notify();
 
 	return ptr;	
 }
 
+void *rte_malloc_flags(int size, unsigned int flags)
+{
+	void *ptr = __rte_slub_alloc(size, flags);
+
+	rte_trace_event(RTE_TRACE_MALLOC, ptr, size, flags);
+	rte_tag_soft_notify();
+	return ptr;
+}
+
+void *rte_malloc_tagged(int size, unsigned int tag)
+{
+	int old = rte_tag_set(tag);
+	void *ptr;
+
+	if(old<0){
+		return NULL;
+	}
+	ptr = rte_malloc(size);
+	rte_tag_set(old);
+	return ptr;
+}
+
 void rte_free(void *ptr)
 {
+	rte_trace_event(RTE_TRACE_FREE, ptr, 0, 0);
 	__rte_slub_free(ptr);
 }
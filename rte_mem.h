@@ -1,7 +1,46 @@
 #ifndef __RTE_MEM_H__
 #define __RTE_MEM_H__
+#include <stddef.h>
+#include "rte_buddy.h"
+#include "rte_slub.h"
+
+/* 内存池的后备存储 */
+enum rte_mem_backend{
+	RTE_MEM_HUGETLBFS, // hugetlbfs中的文件, 大页大小由挂载点决定(2MB或1GB)
+	RTE_MEM_ANON_HUGETLB, // 匿名映射, MAP_HUGETLB
+	RTE_MEM_THP, // 匿名映射, 通过madvise(MADV_HUGEPAGE)使用透明大页
+	RTE_MEM_4K, // 普通的4KB页，用于没有大页的测试机器
+	RTE_MEM_BACKEND_NUM
+};
+
+/* 预先触发缺页的方式 */
+enum rte_mem_prefault{
+	RTE_PREFAULT_NONE,
+	RTE_PREFAULT_POPULATE, // mmap时使用MAP_POPULATE
+	RTE_PREFAULT_THREADS, // 由prefault_threads个线程并行地访问每一页
+};
+
+struct rte_mem_config{
+	int backend; // enum rte_mem_backend
+	size_t size; // 内存池的字节数(包括末尾的元数据)，向上取整为大页大小的整数倍
+	uint32_t huge_shift; // 大页大小, 21(2MB)或30(1GB)，为0时使用21
+	const char *hugetlbfs_dir; // RTE_MEM_HUGETLBFS使用，为NULL时使用/dev/hugepages
+	unsigned long addr; // 映射的固定地址，为0时由内核选择
+	int persistent; // 仅RTE_MEM_HUGETLBFS: 不截断文件，重新使用上一个进程的内存池(见rte_pool.h)
+	int prefault; // enum rte_mem_prefault
+	int prefault_threads; // RTE_PREFAULT_THREADS使用的线程数
+	const struct rte_mem_reserve *reserve; // 新建内存池时预留的Obj，见rte_slub_prewarm()
+	int reserve_num;
+	int prime_cores; // 为Core 0到prime_cores-1预先装载reserve中各规格的Local slab
+};
+
+int rte_mem_init(const struct rte_mem_config *cfg);
+void rte_mem_exit(void);
 
 void *rte_malloc(int size);
+void *rte_malloc_flags(int size, unsigned int flags); // flags: RTE_GFP_*
+void *rte_malloc_tagged(int size, unsigned int tag); // 新建的slab记到tag上，见rte_tag.h
 void rte_free(void *ptr);
+void rte_free_deferred(void *ptr); // 宽限期结束后才释放，见rte_rcu.h
 
 #endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include "rte_buddy.h"
+#include "rte_mem.h"
+#include "rte_mempool.h"
+
+static unsigned int mempool_order(unsigned long bytes)
+{
+	unsigned int order = 0;
+
+	while(order<RTE_MAX_ORDER-1 && ((unsigned long)RTE_PAGE_SIZE<<order)<bytes){
+		order++;
+	}
+	return order;
+}
+
+static void mempool_release_blocks(struct rte_mempool *mp)
+{
+	struct rte_page *page, *n;
+	struct rte_page *pages[RTE_MEMPOOL_BULK];
+	unsigned int nr=0;
+
+	list_for_each_entry_safe(page, n, &mp->blocks, lru){
+		list_del(&page->lru);
+		pages[nr++] = page;
+		if(nr==RTE_MEMPOOL_BULK){
+			rte_free_pages_bulk(pages, nr);
+			nr = 0;
+		}
+	}
+	if(nr){
+		rte_free_pages_bulk(pages, nr);
+	}
+	if(mp->slots_page){
+		rte_free_pages(mp->slots_page);
+	}
+}
+
+/*
+ * 创建包含n个大小为elt_size的元素的对象池，cache_size为每个Core的本地缓存的容量，
+ * 为0时不使用本地缓存
+ * */
+struct rte_mempool *rte_mempool_create(uint32_t n, uint32_t elt_size, uint32_t cache_size)
+{
+	struct rte_mempool *mp;
+	struct rte_page *pages[RTE_MEMPOOL_BULK];
+	unsigned long block_size;
+	uint32_t slots, per_block, i, j, k, nr, count=0;
+	unsigned int order;
+	void *objs[64];
+	char *addr;
+
+	elt_size = (elt_size+RTE_MEMPOOL_ALIGN-1)&~(RTE_MEMPOOL_ALIGN-1);
+	if(!n||n>RTE_MEMPOOL_MAX_ELTS||!elt_size||
+	   elt_size>(RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1))||cache_size>RTE_MEMPOOL_CACHE_MAX){
+		return NULL;
+	}
+	mp = rte_malloc(sizeof(struct rte_mempool));
+	if(NULL==mp){
+		return NULL;
+	}
+	memset(mp, 0, sizeof(struct rte_mempool));
+	INIT_LIST_HEAD(&mp->blocks);
+	mp->elt_size = elt_size;
+	mp->size = n;
+
+	for(slots=1; slots<n; slots<<=1)
+		;
+	mp->slots_page = rte_get_pages(mempool_order((unsigned long)slots*sizeof(void *)));
+	if(NULL==mp->slots_page){
+		goto fail;
+	}
+	rte_ring_init(&mp->ring, rte_page_to_virt(mp->slots_page), slots);
+
+	/*
+	 * 每次分配能容纳剩余元素的最小的块，最大为Buddy系统的最大块。
+	 * 需要多个最大块时一次批量分配
+	 * */
+	while(count<n){
+		order = mempool_order((unsigned long)(n-count)*elt_size);
+		block_size = (unsigned long)RTE_PAGE_SIZE<<order;
+		per_block = block_size/elt_size;
+		nr = (n-count)/per_block;
+		nr = nr<1 ? 1 : (nr>RTE_MEMPOOL_BULK ? RTE_MEMPOOL_BULK : nr);
+		nr = rte_get_pages_bulk(order, nr, pages);
+		if(!nr){
+			goto fail;
+		}
+		for(k=0; k<nr; k++){
+			list_add_tail(&pages[k]->lru, &mp->blocks);
+			addr = rte_page_to_virt(pages[k]);
+			for(i=0; i<per_block && count<n; i+=j){
+				for(j=0; j<64 && i+j<per_block && count<n; j++, count++){
+					objs[j] = addr + (unsigned long)(i+j)*elt_size;
+				}
+				rte_ring_enqueue_bulk(&mp->ring, objs, j);
+			}
+		}
+	}
+
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		mp->cache[i].size = cache_size;
+		mp->cache[i].flushthresh = cache_size + cache_size/2;
+		mp->cache[i].len = 0;
+	}
+	return mp;
+
+fail:
+	mempool_release_blocks(mp);
+	rte_free(mp);
+	return NULL;
+}
+
+/* 释放对象池，调用前所有元素都应已放回 */
+void rte_mempool_free(struct rte_mempool *mp)
+{
+	if(NULL==mp){
+		return;
+	}
+	if(rte_mempool_avail_count(mp)!=mp->size){
+		printf("rte_mempool: %u elements are still in use.\n", mp->size-rte_mempool_avail_count(mp));
+	}
+	mempool_release_blocks(mp);
+	rte_free(mp);
+}
@@ -0,0 +1,110 @@
+#ifndef __RTE_MEMPOOL_H__
+#define __RTE_MEMPOOL_H__
+#include "rte_types.h"
+#include "rte_list.h"
+#include "rte_lcore.h"
+#include "rte_buddy.h"
+#include "rte_ring.h"
+
+/*
+ * 固定大小的对象池(与DPDK的rte_mempool语义相同)。
+ * 创建时从Buddy系统分配组合页，一次性切分出全部元素放入无锁环形队列，
+ * 之后的分配与释放不再经过Slub与Buddy系统。每个Core有一个本地缓存，
+ * 缓存为空或过满时才成批地访问环形队列。
+ * 环形队列的槽位也来自一个Buddy块，因此元素个数不超过RTE_MEMPOOL_MAX_ELTS
+ * */
+#define RTE_MEMPOOL_ALIGN 64 // 元素按cache line对齐
+#define RTE_MEMPOOL_CACHE_MAX 512 // 每个Core的本地缓存的最大容量
+#define RTE_MEMPOOL_MAX_ELTS ((RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1))/sizeof(void *))
+#define RTE_MEMPOOL_BULK 16 // 创建与释放时一次批量分配/归还的块数
+
+struct rte_mempool_cache{
+	uint32_t size; // 目标容量
+	uint32_t flushthresh; // 放回后将超过此值时，先把缓存中的元素全部放回环形队列
+	uint32_t len;
+	void *objs[RTE_MEMPOOL_CACHE_MAX*2];
+}__attribute__((aligned(64)));
+
+struct rte_mempool{
+	struct rte_ring ring;
+	uint32_t elt_size; // 对齐后的元素大小
+	uint32_t size; // 元素总数
+	struct list_head blocks; // 切分元素的组合页，通过page->lru链接
+	struct rte_page *slots_page; // 环形队列槽位所在的页
+	struct rte_mempool_cache cache[RTE_MAX_CPU_NUM];
+};
+
+struct rte_mempool *rte_mempool_create(uint32_t n, uint32_t elt_size, uint32_t cache_size);
+void rte_mempool_free(struct rte_mempool *mp);
+
+/* 可用元素的个数(包括各Core缓存中的元素，为近似值) */
+static inline uint32_t rte_mempool_avail_count(struct rte_mempool *mp)
+{
+	uint32_t count = rte_ring_count(&mp->ring);
+	int i;
+
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		count += mp->cache[i].len;
+	}
+	return count;
+}
+
+/* 放回n个元素，不会失败 */
+static inline void rte_mempool_put_bulk(struct rte_mempool *mp, void * const *objs, unsigned int n)
+{
+	struct rte_mempool_cache *c = mp->cache + rte_get_self_id();
+	unsigned int i;
+
+	if(unlikely(!c->size||n>RTE_MEMPOOL_CACHE_MAX)){
+		rte_ring_enqueue_bulk(&mp->ring, objs, n);
+		return;
+	}
+	if(unlikely(c->len+n>c->flushthresh)){
+		rte_ring_enqueue_bulk(&mp->ring, c->objs, c->len);
+		c->len = 0;
+	}
+	for(i=0;i<n;i++){
+		c->objs[c->len+i] = objs[i];
+	}
+	c->len += n;
+}
+
+/* 取出n个元素，可用元素不足时不取出任何元素并返回-1 */
+static inline int rte_mempool_get_bulk(struct rte_mempool *mp, void **objs, unsigned int n)
+{
+	struct rte_mempool_cache *c = mp->cache + rte_get_self_id();
+	uint32_t req;
+	unsigned int i;
+
+	if(unlikely(!c->size||n>RTE_MEMPOOL_CACHE_MAX)){
+		return rte_ring_dequeue_bulk(&mp->ring, objs, n) ? 0 : -1;
+	}
+	if(unlikely(c->len<n)){ // 从环形队列补充到size个之后再分配
+		req = n + c->size - c->len;
+		if(!rte_ring_dequeue_bulk(&mp->ring, c->objs+c->len, req)){
+			return rte_ring_dequeue_bulk(&mp->ring, objs, n) ? 0 : -1;
+		}
+		c->len += req;
+	}
+	for(i=0;i<n;i++){
+		objs[i] = c->objs[--c->len];
+	}
+	return 0;
+}
+
+static inline void *rte_mempool_get(struct rte_mempool *mp)
+{
+	void *obj;
+
+	if(rte_mempool_get_bulk(mp, &obj, 1)<0){
+		return NULL;
+	}
+	return obj;
+}
+
+static inline void rte_mempool_put(struct rte_mempool *mp, void *obj)
+{
+	rte_mempool_put_bulk(mp, &obj, 1);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rte_stats.h"
+
+/*
+ * 查看运行中进程的分配器状态:
+ * 	./rte_memstat <pid> [-i interval_ms] [-n count]
+ * 只读地映射进程发布的共享内存段，不会暂停或影响被查看的进程
+ * */
+
+static void print_stats(int pid, struct rte_stats *st)
+{
+	struct rte_stats_zone *z = &st->zone;
+	struct rte_stats_cache *c;
+	struct rte_tag_stat *t;
+	uint32_t i;
+
+	printf("\033[H\033[J"); // 清屏
+	printf("rte_memstat pid %d  updated %lu.%03lus\n\n", pid,
+			st->update_time/1000000000UL, (st->update_time/1000000UL)%1000);
+	printf("zone: pages %u  free %u (%.1f%%)  arenas %u  frag %u.%u%%  %s\n",
+			z->page_num, z->free_pages, z->page_num ? 100.0*z->free_pages/z->page_num : 0,
+			z->arena_num, z->frag_index/10, z->frag_index%10, z->pressure ? "PRESSURE" : "");
+	printf("watermark: min %u low %u high %u\n", z->watermark[WMARK_MIN],
+			z->watermark[WMARK_LOW], z->watermark[WMARK_HIGH]);
+	printf("free_area:");
+	for(i=0; i<RTE_MAX_ORDER; i++){
+		printf(" %u", z->nr_free[i]);
+	}
+	printf("\n\n");
+
+	printf("%8s %5s %7s %7s %8s %8s %12s %12s\n", "size", "order", "objects",
+			"min_par", "partial", "slabs", "inuse", "slow_path");
+	for(i=0; i<st->cache_num && i<RTE_SHM_CACHE_NUM; i++){
+		c = st->cache + i;
+		printf("%8u %5u %7u %7u %8lu %8lu %12lu %12lu\n", c->size, c->order, c->objects,
+				c->min_partial, c->nr_partial, c->nr_slabs, c->inuse, c->alloc_slow);
+	}
+
+	printf("\n%4s %10s %10s %10s %10s %8s %8s\n", "tag", "pages", "peak", "soft", "hard",
+			"soft_ev", "hard_fail");
+	for(i=1; i<RTE_TAG_NUM; i++){ // tag 0不统计
+		t = st->tag + i;
+		if(!t->peak && !t->soft_limit && !t->hard_limit){
+			continue;
+		}
+		printf("%4u %10ld %10ld %10lu %10lu %8lu %8lu\n", i, t->pages, t->peak,
+				t->soft_limit, t->hard_limit, t->soft_events, t->hard_fails);
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	char name[64];
+	struct rte_stats *shm;
+	struct rte_stats snap;
+	int interval_ms = 1000;
+	int count = -1;
+	int pid;
+	int fd;
+	int opt;
+
+	if(argc<2){
+		printf("usage: %s <pid> [-i interval_ms] [-n count]\n", argv[0]);
+		return -1;
+	}
+	pid = atoi(argv[1]);
+	optind = 2;
+	while((opt=getopt(argc, argv, "i:n:"))!=-1){
+		switch(opt){
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s <pid> [-i interval_ms] [-n count]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	snprintf(name, sizeof(name), RTE_STATS_SHM_NAME, pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if(fd<0){
+		perror("shm_open");
+		return -1;
+	}
+	shm = mmap(NULL, sizeof(struct rte_stats), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(shm==MAP_FAILED){
+		perror("mmap");
+		return -1;
+	}
+	if(shm->magic!=RTE_STATS_MAGIC||shm->version!=RTE_STATS_VERSION){
+		printf("Bad stats segment %s.\n", name);
+		return -1;
+	}
+
+	while(count){
+		if(!rte_stats_read(shm, &snap)){
+			print_stats(pid, &snap);
+		}
+		if(count>0){
+			count--;
+		}
+		if(count){
+			usleep(interval_ms*1000);
+		}
+	}
+	munmap(shm, sizeof(struct rte_stats));
+	return 0;
+}
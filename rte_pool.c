@@ -0,0 +1,174 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rte_pool.h"
+
+static struct rte_pool *global_pool;
+static void *pool_addr;
+static size_t pool_size;
+
+/* 页数取能使页与元数据一起放入size字节的最大值，只与size有关 */
+static inline uint32_t pool_page_num(size_t size)
+{
+	if(size<=sizeof(struct rte_pool)){
+		return 0;
+	}
+	return (size - sizeof(struct rte_pool))/(RTE_PAGE_SIZE + sizeof(struct rte_page));
+}
+
+static int pool_header_valid(struct rte_pool_header *h, unsigned long addr, size_t size)
+{
+	return h->magic==RTE_POOL_MAGIC && h->version==RTE_POOL_VERSION &&
+		h->page_desc_size==sizeof(struct rte_page) &&
+		h->cache_desc_size==sizeof(struct rte_mem_cache) &&
+		h->zone_desc_size==sizeof(struct rte_mem_zone) &&
+		h->cache_num==RTE_SHM_CACHE_NUM &&
+		h->map_addr==addr && h->map_size==size &&
+		h->page_num==pool_page_num(size);
+}
+
+static int pool_attach(struct rte_pool *pool)
+{
+	if(rte_buddy_system_attach(&pool->zone)<0){
+		return -1;
+	}
+	return rte_slub_system_attach(pool->mem_cache, RTE_SHM_CACHE_NUM);
+}
+
+static int pool_init(struct rte_pool *pool, unsigned long addr, size_t size)
+{
+	struct rte_pool_header *h = &pool->header;
+	uint32_t page_num = pool_page_num(size);
+
+	memset(pool, 0, sizeof(struct rte_pool) + page_num*sizeof(struct rte_page));
+	if(rte_buddy_system_init(&pool->zone, addr, pool->page, page_num)<0){
+		return -1;
+	}
+	if(rte_slub_system_init(pool->mem_cache, RTE_SHM_CACHE_NUM)<0){
+		return -1;
+	}
+	h->version = RTE_POOL_VERSION;
+	h->page_desc_size = sizeof(struct rte_page);
+	h->cache_desc_size = sizeof(struct rte_mem_cache);
+	h->zone_desc_size = sizeof(struct rte_mem_zone);
+	h->cache_num = RTE_SHM_CACHE_NUM;
+	h->map_addr = addr;
+	h->map_size = size;
+	h->page_num = page_num;
+	__atomic_store_n(&h->magic, RTE_POOL_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * 在已映射的内存[virtaddr, virtaddr+size)上建立内存池。
+ * reuse非0且头部有效时重新使用原有的内存池，否则重新初始化。
+ * 返回RTE_POOL_ATTACHED、RTE_POOL_NEW，失败时返回-1
+ * */
+int rte_pool_setup(void *virtaddr, size_t size, int reuse)
+{
+	unsigned long addr = (unsigned long)virtaddr;
+	struct rte_pool *pool;
+	int ret = RTE_POOL_NEW;
+
+	if(global_pool||pool_page_num(size)<(1U<<(RTE_MAX_ORDER-1))){
+		return -1;
+	}
+	pool = (struct rte_pool *)((char *)virtaddr + (size_t)pool_page_num(size)*RTE_PAGE_SIZE);
+	if(reuse && pool_header_valid(&pool->header, addr, size)){
+		if(pool->header.clean && pool_attach(pool)==0){
+			ret = RTE_POOL_ATTACHED;
+		}else{
+			printf("rte_pool: the pool was not shut down cleanly, reinitializing.\n");
+		}
+	}
+	if(ret==RTE_POOL_NEW && pool_init(pool, addr, size)<0){
+		return -1;
+	}
+	pool->header.clean = 0; // 直到rte_pool_release()前，内存池的状态都可能不一致
+	global_pool = pool;
+	pool_addr = virtaddr;
+	pool_size = size;
+	return ret;
+}
+
+/* 标记内存池已正常关闭，不解除映射。调用前所有线程都应停止分配与释放 */
+void rte_pool_release(void)
+{
+	if(NULL==global_pool){
+		return;
+	}
+	__atomic_store_n(&global_pool->header.clean, 1, __ATOMIC_RELEASE);
+	msync(pool_addr, pool_size, MS_SYNC);
+	global_pool = NULL;
+}
+
+/*
+ * 把path映射到固定地址addr，size须为大页大小的整数倍。
+ * 返回值与rte_pool_setup()相同
+ * */
+int rte_pool_open(const char *path, unsigned long addr, size_t size)
+{
+	struct stat st;
+	void *virtaddr;
+	int fd, ret;
+
+	if(global_pool){
+		return -1;
+	}
+	fd = open(path, O_CREAT|O_RDWR, 0600);
+	if(fd<0){
+		return -1;
+	}
+	if(fstat(fd, &st)<0||((size_t)st.st_size!=size && ftruncate(fd, size)<0)){
+		close(fd);
+		return -1;
+	}
+	virtaddr = mmap((void *)addr, size, PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
+	close(fd);
+	if(virtaddr==MAP_FAILED){
+		return -1;
+	}
+	ret = rte_pool_setup(virtaddr, size, 1);
+	if(ret<0){
+		munmap(virtaddr, size);
+	}
+	return ret;
+}
+
+void rte_pool_close(void)
+{
+	void *addr = pool_addr;
+	size_t size = pool_size;
+
+	if(NULL==global_pool){
+		return;
+	}
+	rte_pool_release();
+	munmap(addr, size);
+}
+
+struct rte_pool *rte_pool_get(void)
+{
+	return global_pool;
+}
+
+int rte_pool_set_root(unsigned int idx, void *ptr)
+{
+	if(NULL==global_pool||idx>=RTE_POOL_ROOTS){
+		return -1;
+	}
+	global_pool->header.roots[idx] = ptr;
+	return 0;
+}
+
+void *rte_pool_get_root(unsigned int idx)
+{
+	if(NULL==global_pool||idx>=RTE_POOL_ROOTS){
+		return NULL;
+	}
+	return global_pool->header.roots[idx];
+}
@@ -0,0 +1,52 @@
+#ifndef __RTE_POOL_H__
+#define __RTE_POOL_H__
+#include "rte_buddy.h"
+#include "rte_slub.h"
+
+/*
+ * 持久内存池。内存池文件(通常在hugetlbfs中)映射到固定地址，
+ * 前面是交给Buddy系统的页，末尾是struct rte_pool，包括头部、zone、cache与页描述符，
+ * 因此其中的指针在进程重启后仍然有效。
+ * 进程正常退出时调用rte_pool_close()标记clean；再次rte_pool_open()时若头部匹配且为clean，
+ * 直接重新使用原有的zone与cache，跳过rte_buddy_system_init()与cache的预热，
+ * 应用通过rte_pool_get_root()取回自己的根对象。否则重新初始化整个内存池。
+ * rte_pool_setup()/rte_pool_release()用于调用者自己映射的内存，见rte_mem_init()
+ * */
+#define RTE_POOL_MAGIC 0x52544d50 // "RTMP"
+#define RTE_POOL_VERSION 1
+#define RTE_POOL_ROOTS 16 // 应用可保存的根对象个数
+
+/* rte_pool_open()的返回值 */
+#define RTE_POOL_NEW 0 // 新建或重新初始化了内存池
+#define RTE_POOL_ATTACHED 1 // 重新使用了上一个进程的内存池
+
+struct rte_pool_header{
+	uint32_t magic; // 初始化完成后最后写入
+	uint32_t version;
+	uint32_t page_desc_size; // 以下用于检查结构体布局是否与上一个进程相同
+	uint32_t cache_desc_size;
+	uint32_t zone_desc_size;
+	uint32_t cache_num;
+	uint64_t map_addr;
+	uint64_t map_size;
+	volatile uint32_t clean; // 1: 上一个进程正常关闭
+	uint32_t page_num;
+	void *roots[RTE_POOL_ROOTS];
+};
+
+struct rte_pool{
+	struct rte_pool_header header;
+	struct rte_mem_zone zone;
+	struct rte_mem_cache mem_cache[RTE_SHM_CACHE_NUM];
+	struct rte_page page[0];
+};
+
+int rte_pool_setup(void *virtaddr, size_t size, int reuse);
+void rte_pool_release(void);
+int rte_pool_open(const char *path, unsigned long addr, size_t size);
+void rte_pool_close(void);
+struct rte_pool *rte_pool_get(void);
+int rte_pool_set_root(unsigned int idx, void *ptr);
+void *rte_pool_get_root(unsigned int idx);
+
+#endif
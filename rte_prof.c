@@ -0,0 +1,271 @@
+#include <execinfo.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rte_list.h"
+#include "rte_spinlock.h"
+#include "rte_cycles.h"
+#include "rte_prof.h"
+
+struct prof_site{
+	uint64_t hash; // 0表示空位
+	uint32_t depth;
+	void *stack[RTE_PROF_DEPTH];
+	uint64_t alloc_objs; // 累计被采样的分配
+	uint64_t alloc_bytes;
+	uint64_t live_objs; // 被采样且尚未释放的分配
+	uint64_t live_bytes;
+};
+
+struct prof_object{
+	void *ptr; // NULL表示空位
+	uint32_t size;
+	uint32_t site;
+};
+
+__thread int64_t rte_prof_countdown;
+static __thread uint64_t prof_rng;
+
+static volatile uint64_t prof_interval; // 平均采样间隔(字节)，0表示关闭
+static uint64_t prof_dump_interval; // 输出时使用的采样间隔
+static rte_spinlock_t prof_lock;
+static struct prof_site *prof_sites;
+static struct prof_object *prof_objects;
+static uint64_t prof_dropped;
+
+static inline uint64_t prof_hash_ptr(void *ptr)
+{
+	return ((uint64_t)(unsigned long)ptr>>4)*0x9E3779B97F4A7C15ULL;
+}
+
+/* 间隔服从均值为mean的指数分布，使每个字节被采样的概率相同 */
+static int64_t prof_next_interval(uint64_t mean)
+{
+	double u;
+
+	if(unlikely(!prof_rng)){
+		prof_rng = rte_rdtsc()|1;
+	}
+	prof_rng ^= prof_rng<<13;
+	prof_rng ^= prof_rng>>7;
+	prof_rng ^= prof_rng<<17;
+	u = ((prof_rng>>11)+1)*(1.0/9007199254740992.0); // (0, 1]
+	return (int64_t)(-log(u)*mean) + 1;
+}
+
+int rte_prof_start(uint64_t sample_bytes)
+{
+	if(!sample_bytes){
+		return -1;
+	}
+	rte_spinlock_lock(&prof_lock);
+	if(NULL==prof_sites){
+		prof_sites = calloc(RTE_PROF_SITES, sizeof(struct prof_site));
+		prof_objects = calloc(RTE_PROF_OBJECTS, sizeof(struct prof_object));
+		if(NULL==prof_sites||NULL==prof_objects){
+			free(prof_sites);
+			free(prof_objects);
+			prof_sites = NULL;
+			prof_objects = NULL;
+			rte_spinlock_unlock(&prof_lock);
+			return -1;
+		}
+	}else{
+		memset(prof_sites, 0, RTE_PROF_SITES*sizeof(struct prof_site));
+		memset(prof_objects, 0, RTE_PROF_OBJECTS*sizeof(struct prof_object));
+	}
+	prof_dropped = 0;
+	prof_dump_interval = sample_bytes;
+	rte_spinlock_unlock(&prof_lock);
+	__atomic_store_n(&prof_interval, sample_bytes, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* 停止采样，已采样的Obj被释放时仍会更新统计，rte_prof_dump()仍可使用 */
+void rte_prof_stop(void)
+{
+	__atomic_store_n(&prof_interval, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t prof_find_site(uint64_t hash, void **stack, int depth)
+{
+	uint32_t i = hash & (RTE_PROF_SITES-1);
+	uint32_t n;
+
+	for(n=0;n<RTE_PROF_SITES;n++,i=(i+1)&(RTE_PROF_SITES-1)){
+		if(!prof_sites[i].hash){
+			prof_sites[i].hash = hash;
+			prof_sites[i].depth = depth;
+			memcpy(prof_sites[i].stack, stack, depth*sizeof(void *));
+			return i;
+		}
+		if(prof_sites[i].hash==hash && prof_sites[i].depth==(uint32_t)depth &&
+		   !memcmp(prof_sites[i].stack, stack, depth*sizeof(void *))){
+			return i;
+		}
+	}
+	return RTE_PROF_SITES;
+}
+
+/*
+ * 分配的字节数使rte_prof_countdown小于0时由__rte_slub_alloc()调用。
+ * 返回1表示ptr已被记录，调用者需要在Obj所在的页上标记PG_sampled
+ * */
+int rte_prof_sample(void *ptr, uint32_t size)
+{
+	uint64_t interval = __atomic_load_n(&prof_interval, __ATOMIC_ACQUIRE);
+	void *stack[RTE_PROF_DEPTH+1];
+	uint64_t hash = 14695981039346656037ULL; // FNV-1a
+	struct prof_object *o;
+	struct prof_site *site;
+	uint32_t idx, n;
+	int depth, i;
+
+	if(!interval){
+		rte_prof_countdown = RTE_PROF_RECHECK;
+		return 0;
+	}
+	rte_prof_countdown = prof_next_interval(interval);
+	if(NULL==ptr){
+		return 0;
+	}
+	depth = backtrace(stack, RTE_PROF_DEPTH+1) - 1; // 去掉本函数
+	if(depth<=0){
+		return 0;
+	}
+	for(i=1;i<=depth;i++){
+		hash = (hash ^ (uint64_t)(unsigned long)stack[i])*1099511628211ULL;
+	}
+	hash |= 1;
+
+	rte_spinlock_lock(&prof_lock);
+	idx = prof_find_site(hash, stack+1, depth);
+	if(idx>=RTE_PROF_SITES){
+		goto dropped;
+	}
+	n = prof_hash_ptr(ptr) & (RTE_PROF_OBJECTS-1);
+	for(i=0; i<RTE_PROF_OBJECTS && prof_objects[n].ptr; i++){
+		n = (n+1)&(RTE_PROF_OBJECTS-1);
+	}
+	if(i==RTE_PROF_OBJECTS){
+		goto dropped;
+	}
+	o = prof_objects + n;
+	o->ptr = ptr;
+	o->size = size;
+	o->site = idx;
+	site = prof_sites + idx;
+	site->alloc_objs++;
+	site->alloc_bytes += size;
+	site->live_objs++;
+	site->live_bytes += size;
+	rte_spinlock_unlock(&prof_lock);
+	return 1;
+
+dropped:
+	prof_dropped++;
+	rte_spinlock_unlock(&prof_lock);
+	return 0;
+}
+
+/* 释放的Obj所在的页标记了PG_sampled时由__rte_slub_free()调用 */
+void rte_prof_free(void *ptr)
+{
+	struct prof_site *site;
+	uint32_t i, j, k;
+	uint32_t n;
+
+	rte_spinlock_lock(&prof_lock);
+	if(NULL==prof_objects){
+		goto out;
+	}
+	i = prof_hash_ptr(ptr) & (RTE_PROF_OBJECTS-1);
+	for(n=0; n<RTE_PROF_OBJECTS && prof_objects[i].ptr!=ptr; n++){
+		if(!prof_objects[i].ptr){
+			goto out; // 同页的其他Obj被采样，本Obj没有被采样
+		}
+		i = (i+1)&(RTE_PROF_OBJECTS-1);
+	}
+	if(n==RTE_PROF_OBJECTS){
+		goto out;
+	}
+	site = prof_sites + prof_objects[i].site;
+	site->live_objs--;
+	site->live_bytes -= prof_objects[i].size;
+
+	/* 删除后把探测序列中的后续项前移 */
+	prof_objects[i].ptr = NULL;
+	for(j=(i+1)&(RTE_PROF_OBJECTS-1); prof_objects[j].ptr; j=(j+1)&(RTE_PROF_OBJECTS-1)){
+		k = prof_hash_ptr(prof_objects[j].ptr) & (RTE_PROF_OBJECTS-1);
+		if((j>i) ? (k>i&&k<=j) : (k>i||k<=j)){
+			continue;
+		}
+		prof_objects[i] = prof_objects[j];
+		prof_objects[j].ptr = NULL;
+		i = j;
+	}
+out:
+	rte_spinlock_unlock(&prof_lock);
+}
+
+/*
+ * 输出pprof的legacy heap profile格式(heap_v2)，数值为采样得到的原始值，
+ * 由pprof根据采样间隔换算。随后附上/proc/self/maps用于符号化
+ * */
+int rte_prof_dump(const char *path)
+{
+	uint64_t live_objs=0, live_bytes=0, alloc_objs=0, alloc_bytes=0;
+	struct prof_site *site;
+	char buf[4096];
+	FILE *fp, *maps;
+	size_t len;
+	uint32_t i, j;
+
+	fp = fopen(path, "w");
+	if(NULL==fp){
+		return -1;
+	}
+	rte_spinlock_lock(&prof_lock);
+	if(NULL==prof_sites){
+		rte_spinlock_unlock(&prof_lock);
+		fclose(fp);
+		return -1;
+	}
+	for(i=0;i<RTE_PROF_SITES;i++){
+		site = prof_sites + i;
+		live_objs += site->live_objs;
+		live_bytes += site->live_bytes;
+		alloc_objs += site->alloc_objs;
+		alloc_bytes += site->alloc_bytes;
+	}
+	fprintf(fp, "heap profile: %lu: %lu [%lu: %lu] @ heap_v2/%lu\n", live_objs, live_bytes,
+			alloc_objs, alloc_bytes, prof_dump_interval);
+	for(i=0;i<RTE_PROF_SITES;i++){
+		site = prof_sites + i;
+		if(!site->hash){
+			continue;
+		}
+		fprintf(fp, "%lu: %lu [%lu: %lu] @", site->live_objs, site->live_bytes,
+				site->alloc_objs, site->alloc_bytes);
+		for(j=0;j<site->depth;j++){
+			fprintf(fp, " %p", site->stack[j]);
+		}
+		fprintf(fp, "\n");
+	}
+	if(prof_dropped){
+		fprintf(stderr, "rte_prof: %lu samples dropped.\n", prof_dropped);
+	}
+	rte_spinlock_unlock(&prof_lock);
+
+	fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+	maps = fopen("/proc/self/maps", "r");
+	if(maps){
+		while((len=fread(buf, 1, sizeof(buf), maps))>0){
+			fwrite(buf, 1, len, fp);
+		}
+		fclose(maps);
+	}
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef __RTE_PROF_H__
+#define __RTE_PROF_H__
+#include "rte_types.h"
+
+/*
+ * 采样堆分析。__rte_slub_alloc()每分配约sample_bytes字节(按几何分布随机取间隔，与tcmalloc相同)
+ * 记录一次调用栈，按调用点统计仍在使用的Obj个数与字节数，
+ * rte_prof_dump()输出pprof可读取的heap profile:
+ * 	pprof --text ./prog heap.prof
+ * 关闭采样时快速路径上只有一次计数器的减法和比较
+ * */
+#define RTE_PROF_DEPTH 16 // 每个调用栈最多记录的层数
+#define RTE_PROF_SITES 4096 // 调用点的个数上限
+#define RTE_PROF_OBJECTS 65536 // 同时存活的被采样Obj的个数上限
+#define RTE_PROF_RECHECK (1L<<20) // 关闭采样时，每个线程每分配这么多字节检查一次是否已开启
+
+/* 距离下一次采样还需分配的字节数，每个线程一个 */
+extern __thread int64_t rte_prof_countdown;
+
+int rte_prof_start(uint64_t sample_bytes);
+void rte_prof_stop(void);
+int rte_prof_dump(const char *path);
+int rte_prof_sample(void *ptr, uint32_t size);
+void rte_prof_free(void *ptr);
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "rte_spinlock.h"
+#include "rte_slub.h"
+#include "rte_mem.h"
+#include "rte_rcu.h"
+
+/* 读者的状态，每个Core独占一个cache line */
+struct rte_rcu_reader{
+	volatile uint64_t qs_seq; // 最近一次报告静止状态时看到的gp_seq
+	volatile int online; // 是否已注册
+}__attribute__((aligned(64)));
+
+struct rte_rcu_batch{
+	uint64_t seq; // 宽限期结束的条件: 所有读者的qs_seq >= seq
+	int nr;
+	void *objs[RTE_RCU_BATCH_SIZE];
+};
+
+/* 写者的状态，只由所在Core访问 */
+struct rte_rcu_defer{
+	uint32_t head; // batch[head, tail)已封装，正在等待宽限期
+	uint32_t tail; // batch[tail]正在填充
+	struct rte_rcu_batch batch[RTE_RCU_BATCH_NUM];
+}__attribute__((aligned(64)));
+
+static volatile uint64_t gp_seq __attribute__((aligned(64)));
+static struct rte_rcu_reader rcu_readers[RTE_MAX_CPU_NUM];
+static struct rte_rcu_defer rcu_defers[RTE_MAX_CPU_NUM];
+
+int rte_rcu_register_thread(void)
+{
+	struct rte_rcu_reader *r;
+	int id = rte_get_self_id();
+
+	if(id<0||id>=RTE_MAX_CPU_NUM){
+		return -1;
+	}
+	r = rcu_readers + id;
+	r->qs_seq = __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&r->online, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+void rte_rcu_unregister_thread(void)
+{
+	struct rte_rcu_reader *r = rcu_readers + rte_get_self_id();
+
+	__atomic_store_n(&r->online, 0, __ATOMIC_RELEASE);
+}
+
+/* 所有在线读者中最小的qs_seq，没有在线读者时返回当前的gp_seq */
+static uint64_t rcu_min_qs(void)
+{
+	uint64_t min = __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE);
+	uint64_t qs;
+	int i;
+
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		if(!__atomic_load_n(&rcu_readers[i].online, __ATOMIC_ACQUIRE)){
+			continue;
+		}
+		qs = __atomic_load_n(&rcu_readers[i].qs_seq, __ATOMIC_ACQUIRE);
+		if(qs<min){
+			min = qs;
+		}
+	}
+	return min;
+}
+
+/* 释放宽限期已经结束的批次 */
+static void rcu_reclaim(struct rte_rcu_defer *d)
+{
+	struct rte_rcu_batch *b;
+	uint64_t min;
+	int i;
+
+	if(d->head==d->tail){
+		return;
+	}
+	min = rcu_min_qs();
+	while(d->head!=d->tail){
+		b = d->batch + (d->head%RTE_RCU_BATCH_NUM);
+		if(b->seq>min){
+			break;
+		}
+		for(i=0;i<b->nr;i++){
+			__rte_slub_free(b->objs[i]);
+		}
+		b->nr = 0;
+		d->head++;
+	}
+}
+
+/*
+ * 封装正在填充的批次，开始一个新的宽限期。
+ * 所有批次都在等待时，报告本Core的静止状态并等待最早的批次被释放，
+ * 调用者不能持有读端的引用，见rte_rcu.h
+ * */
+static void rcu_seal(struct rte_rcu_defer *d)
+{
+	struct rte_rcu_batch *b = d->batch + (d->tail%RTE_RCU_BATCH_NUM);
+	struct rte_rcu_reader *r = rcu_readers + rte_get_self_id();
+
+	b->seq = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_SEQ_CST);
+	d->tail++;
+	rcu_reclaim(d);
+	while(d->tail-d->head>=RTE_RCU_BATCH_NUM){
+		if(r->online){
+			__atomic_store_n(&r->qs_seq, __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		}
+		rte_pause();
+		rcu_reclaim(d);
+	}
+}
+
+void rte_rcu_quiescent(void)
+{
+	struct rte_rcu_reader *r = rcu_readers + rte_get_self_id();
+
+	__atomic_store_n(&r->qs_seq, __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	rcu_reclaim(rcu_defers + rte_get_self_id());
+}
+
+void rte_free_deferred(void *ptr)
+{
+	struct rte_rcu_defer *d = rcu_defers + rte_get_self_id();
+	struct rte_rcu_batch *b = d->batch + (d->tail%RTE_RCU_BATCH_NUM);
+
+	if(unlikely(NULL==ptr)){
+		return;
+	}
+	b->objs[b->nr++] = ptr;
+	if(b->nr==RTE_RCU_BATCH_SIZE){
+		rcu_seal(d);
+	}
+}
+
+/* 封装本Core未满的批次，并等待本Core所有延迟释放的对象都被释放 */
+void rte_rcu_flush(void)
+{
+	struct rte_rcu_defer *d = rcu_defers + rte_get_self_id();
+	struct rte_rcu_reader *r = rcu_readers + rte_get_self_id();
+
+	if(d->batch[d->tail%RTE_RCU_BATCH_NUM].nr){
+		rcu_seal(d);
+	}
+	while(d->head!=d->tail){
+		if(r->online){
+			__atomic_store_n(&r->qs_seq, __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		}
+		rte_pause();
+		rcu_reclaim(d);
+	}
+}
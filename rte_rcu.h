@@ -0,0 +1,25 @@
+#ifndef __RTE_RCU_H__
+#define __RTE_RCU_H__
+#include "rte_types.h"
+#include "rte_lcore.h"
+
+/*
+ * 基于静止状态(QSBR)的延迟释放。
+ * 读者无锁地访问共享数据，在不再持有任何共享对象的引用时调用
+ * rte_rcu_quiescent()报告静止状态; 写者摘除对象后调用rte_free_deferred()，
+ * 对象按Core成批地缓存，当所有已注册的读者都经过了一次静止状态
+ * (即一个宽限期结束)后，整批通过__rte_slub_free释放。
+ * 每个Core只能有一个线程，Core序号由rte_set_self_id()设置。
+ * 本Core等待宽限期的批次已满时rte_free_deferred()会等待，rte_rcu_flush()总是等待，
+ * 等待期间报告本Core的静止状态(否则本Core作为读者会阻止自己的宽限期结束)，
+ * 因此与rte_rcu_quiescent()一样，调用它们时本线程不能持有任何读端的引用。
+ * */
+#define RTE_RCU_BATCH_SIZE 64 // 每批缓存的对象个数
+#define RTE_RCU_BATCH_NUM 8 // 每个Core等待宽限期的批次的个数
+
+int rte_rcu_register_thread(void);
+void rte_rcu_unregister_thread(void);
+void rte_rcu_quiescent(void);
+void rte_rcu_flush(void);
+
+#endif
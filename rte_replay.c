@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "rte_buddy.h"
+#include "rte_slub.h"
+#include "rte_mem.h"
+#include "rte_trace.h"
+
+/*
+ * 重放rte_trace记录的文件:
+ * 	./rte_replay <trace> [-p pages]
+ * 事件按tsc排序后在单线程中依次执行，执行前切换到记录时的Core序号，
+ * 因此相同的输入总是得到相同的结果，可用于比较分配策略的改动
+ * */
+
+struct replay_cb{
+	struct rte_mem_zone zone;
+	struct rte_mem_cache mem_cache[RTE_SHM_CACHE_NUM];
+	struct rte_page page[0];
+};
+
+/* 记录的地址到重放时分配得到的地址的映射，开放定址 */
+struct replay_map{
+	uint64_t addr;
+	void *ptr;
+	uint64_t bytes;
+};
+
+/* seq为事件在文件中的位置，排序前记录，tsc相同时保持文件中的先后顺序 */
+struct replay_event{
+	struct rte_trace_event ev;
+	uint64_t seq;
+};
+
+static struct replay_cb *replay_cb;
+static struct replay_map *replay_map;
+static uint64_t replay_map_size;
+
+static int replay_pool_init(unsigned int page_num)
+{
+	void *addr=NULL;
+
+	replay_cb = malloc(sizeof(struct replay_cb) + page_num*sizeof(struct rte_page));
+	if(NULL==replay_cb){
+		return -1;
+	}
+	/* 不预先写入内存池，使RSS只包含分配器实际用到的页 */
+	if(posix_memalign(&addr, RTE_PAGE_SIZE<<(RTE_MAX_ORDER-1), (size_t)page_num*RTE_PAGE_SIZE)){
+		return -1;
+	}
+	if(rte_buddy_system_init(&replay_cb->zone, (unsigned long)addr, replay_cb->page, page_num)<0){
+		return -1;
+	}
+	return rte_slub_system_init(replay_cb->mem_cache, RTE_SHM_CACHE_NUM);
+}
+
+static struct replay_map *map_slot(uint64_t addr)
+{
+	uint64_t i = (addr>>4)*0x9E3779B97F4A7C15ULL;
+
+	for(i&=replay_map_size-1; replay_map[i].addr && replay_map[i].addr!=addr; i=(i+1)&(replay_map_size-1))
+		;
+	return replay_map + i;
+}
+
+/* 删除后把同一探测序列中的后续项前移，保持开放定址的查找正确 */
+static void map_remove(struct replay_map *m)
+{
+	uint64_t i = m - replay_map;
+	uint64_t j = i, k;
+
+	m->addr = 0;
+	for(;;){
+		j = (j+1)&(replay_map_size-1);
+		if(!replay_map[j].addr){
+			return;
+		}
+		k = ((replay_map[j].addr>>4)*0x9E3779B97F4A7C15ULL)&(replay_map_size-1);
+		if((j>i) ? (k>i&&k<=j) : (k>i||k<=j)){
+			continue;
+		}
+		replay_map[i] = replay_map[j];
+		replay_map[j].addr = 0;
+		i = j;
+	}
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+	const struct replay_event *x = a, *y = b;
+
+	if(x->ev.tsc!=y->ev.tsc){
+		return (x->ev.tsc>y->ev.tsc)-(x->ev.tsc<y->ev.tsc);
+	}
+	return (x->seq>y->seq)-(x->seq<y->seq);
+}
+
+static struct replay_event *load_trace(const char *path, uint64_t *nr)
+{
+	struct rte_trace_header hdr;
+	struct replay_event *ev;
+	FILE *fp;
+	uint64_t i;
+	long len;
+
+	fp = fopen(path, "rb");
+	if(NULL==fp){
+		perror("fopen");
+		return NULL;
+	}
+	if(fread(&hdr, sizeof(hdr), 1, fp)!=1||hdr.magic!=RTE_TRACE_MAGIC||
+	   hdr.version!=RTE_TRACE_VERSION||hdr.event_size!=sizeof(struct rte_trace_event)){
+		printf("Bad trace file %s.\n", path);
+		fclose(fp);
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp) - sizeof(hdr);
+	fseek(fp, sizeof(hdr), SEEK_SET);
+	*nr = len/sizeof(struct rte_trace_event);
+	ev = malloc(*nr*sizeof(struct replay_event) + 1);
+	if(NULL==ev){
+		printf("Failed to read trace file %s.\n", path);
+		fclose(fp);
+		return NULL;
+	}
+	for(i=0;i<*nr;i++){
+		if(fread(&ev[i].ev, sizeof(struct rte_trace_event), 1, fp)!=1){
+			printf("Failed to read trace file %s.\n", path);
+			free(ev);
+			fclose(fp);
+			return NULL;
+		}
+		ev[i].seq = i;
+	}
+	fclose(fp);
+	/* qsort不稳定，相同tsc时按文件中的位置排序 */
+	qsort(ev, *nr, sizeof(struct replay_event), cmp_event);
+	return ev;
+}
+
+/* 空闲页中不属于最大块的比例(‰) */
+static unsigned int frag_index(struct rte_mem_zone *zone)
+{
+	uint64_t free_pages=0, max_blocks=0;
+	uint32_t i;
+
+	for(i=0;i<zone->arena_num;i++){
+		free_pages += zone->arena[i].free_zero_num;
+		max_blocks += zone->arena[i].free_area[RTE_MAX_ORDER-1].nr_free;
+	}
+	if(!free_pages){
+		return 0;
+	}
+	return (free_pages - (max_blocks<<(RTE_MAX_ORDER-1)))*1000/free_pages;
+}
+
+static double replay_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct replay_event *ev;
+	struct rte_trace_event *e;
+	struct rte_mem_zone *zone;
+	struct replay_map *m;
+	struct rte_page *page;
+	struct rusage ru;
+	unsigned int page_num = 16384;
+	uint64_t nr, i, failed=0, unmatched=0;
+	uint64_t live=0, used, peak_used=0, peak_live=0;
+	double start, elapsed;
+	void *ptr;
+	int opt;
+
+	if(argc<2){
+		printf("usage: %s <trace> [-p pages]\n", argv[0]);
+		return -1;
+	}
+	optind = 2;
+	while((opt=getopt(argc, argv, "p:"))!=-1){
+		switch(opt){
+		case 'p':
+			page_num = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s <trace> [-p pages]\n", argv[0]);
+			return -1;
+		}
+	}
+	ev = load_trace(argv[1], &nr);
+	if(NULL==ev){
+		return -1;
+	}
+	for(replay_map_size=1024; replay_map_size<nr*2; replay_map_size<<=1)
+		;
+	replay_map = calloc(replay_map_size, sizeof(struct replay_map));
+	if(NULL==replay_map||replay_pool_init(page_num)<0){
+		printf("Failed to init memory pool.\n");
+		return -1;
+	}
+	zone = &replay_cb->zone;
+
+	start = replay_now();
+	for(i=0;i<nr;i++){
+		e = &ev[i].ev;
+		rte_set_self_id(e->core%RTE_MAX_CPU_NUM);
+		switch(e->type){
+		case RTE_TRACE_MALLOC:
+		case RTE_TRACE_GET_PAGES:
+		case RTE_TRACE_GET_PAGES_EXACT:
+			if(!e->addr){ // 记录时就失败的分配
+				break;
+			}
+			if(e->type==RTE_TRACE_MALLOC){
+				ptr = rte_malloc_flags(e->size, e->flags);
+			}else{
+				page = e->type==RTE_TRACE_GET_PAGES ? rte_get_pages(e->size) :
+					rte_get_pages_exact(e->size);
+				ptr = page ? rte_page_to_virt(page) : NULL;
+			}
+			if(NULL==ptr){
+				failed++;
+				break;
+			}
+			m = map_slot(e->addr);
+			if(m->addr){ // 记录中缺少对应的释放事件，丢弃旧的映射
+				unmatched++;
+				live -= m->bytes;
+			}
+			m->addr = e->addr;
+			m->ptr = ptr;
+			if(e->type==RTE_TRACE_MALLOC){
+				m->bytes = e->size;
+			}else if(e->type==RTE_TRACE_GET_PAGES){
+				m->bytes = (uint64_t)RTE_PAGE_SIZE<<e->size;
+			}else{
+				m->bytes = (uint64_t)RTE_PAGE_SIZE*e->size;
+			}
+			live += m->bytes;
+			break;
+		case RTE_TRACE_FREE:
+		case RTE_TRACE_FREE_PAGES:
+		case RTE_TRACE_FREE_PAGES_EXACT:
+			if(!e->addr){
+				break;
+			}
+			m = map_slot(e->addr);
+			if(!m->addr){
+				unmatched++;
+				break;
+			}
+			if(e->type==RTE_TRACE_FREE){
+				rte_free(m->ptr);
+			}else if(e->type==RTE_TRACE_FREE_PAGES){
+				rte_free_pages(rte_virt_to_head_page(m->ptr));
+			}else{
+				rte_free_pages_exact(rte_virt_to_head_page(m->ptr));
+			}
+			live -= m->bytes;
+			map_remove(m);
+			break;
+		}
+		used = zone->page_num - rte_zone_free_pages();
+		if(used>peak_used){
+			peak_used = used;
+			peak_live = live;
+		}
+	}
+	elapsed = replay_now() - start;
+
+	getrusage(RUSAGE_SELF, &ru);
+	printf("events: %lu  failed: %lu  unmatched: %lu\n", nr, failed, unmatched);
+	printf("throughput: %.0f ops/s\n", nr/elapsed);
+	printf("peak pages: %lu (%lu KB)  live at peak: %lu KB  utilization: %.1f%%\n",
+			peak_used, peak_used*RTE_PAGE_SIZE/1024, peak_live/1024,
+			peak_used ? 100.0*peak_live/(peak_used*RTE_PAGE_SIZE) : 0);
+	used = zone->page_num - rte_zone_free_pages();
+	printf("final pages: %lu  live: %lu KB  frag index: %u.%u%%\n", used, live/1024,
+			frag_index(zone)/10, frag_index(zone)%10);
+	printf("peak RSS: %ld KB\n", ru.ru_maxrss);
+	free(replay_map);
+	free(ev);
+	return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef __RTE_RING_H__
+#define __RTE_RING_H__
+#include "rte_types.h"
+#include "rte_list.h"
+#include "rte_spinlock.h"
+
+/*
+ * 无锁的多生产者/多消费者环形队列(与DPDK的rte_ring相同的做法)。
+ * 生产者先用CAS推进prod.head占用一段槽位，写入对象后按占用的顺序推进prod.tail；
+ * 消费者对cons.head/cons.tail同样处理。bulk接口要么全部成功，要么不做任何操作
+ * */
+struct rte_ring_headtail{
+	volatile uint32_t head;
+	volatile uint32_t tail;
+}__attribute__((aligned(64)));
+
+struct rte_ring{
+	struct rte_ring_headtail prod;
+	struct rte_ring_headtail cons;
+	uint32_t size; // 槽位个数，2的幂
+	uint32_t mask;
+	void **slots;
+};
+
+/* slots由调用者提供，包含size个指针，size须为2的幂 */
+static inline void rte_ring_init(struct rte_ring *r, void **slots, uint32_t size)
+{
+	r->prod.head = r->prod.tail = 0;
+	r->cons.head = r->cons.tail = 0;
+	r->size = size;
+	r->mask = size-1;
+	r->slots = slots;
+}
+
+static inline uint32_t rte_ring_count(const struct rte_ring *r)
+{
+	return __atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE) -
+		__atomic_load_n(&r->cons.tail, __ATOMIC_ACQUIRE);
+}
+
+/* 等待先占用槽位的其他线程完成，再公布本线程写入/读出的槽位 */
+static inline void __rte_ring_update_tail(struct rte_ring_headtail *ht, uint32_t old, uint32_t new)
+{
+	while(__atomic_load_n(&ht->tail, __ATOMIC_RELAXED)!=old){
+		rte_pause();
+	}
+	__atomic_store_n(&ht->tail, new, __ATOMIC_RELEASE);
+}
+
+static inline unsigned int rte_ring_enqueue_bulk(struct rte_ring *r, void * const *objs, unsigned int n)
+{
+	uint32_t head, next, free;
+	unsigned int i;
+
+	head = __atomic_load_n(&r->prod.head, __ATOMIC_RELAXED);
+	do{
+		free = r->size + __atomic_load_n(&r->cons.tail, __ATOMIC_ACQUIRE) - head;
+		if(unlikely(n>free)){
+			return 0;
+		}
+		next = head + n;
+	}while(!__atomic_compare_exchange_n(&r->prod.head, &head, next, 0,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	for(i=0;i<n;i++){
+		r->slots[(head+i)&r->mask] = objs[i];
+	}
+	__rte_ring_update_tail(&r->prod, head, next);
+	return n;
+}
+
+static inline unsigned int rte_ring_dequeue_bulk(struct rte_ring *r, void **objs, unsigned int n)
+{
+	uint32_t head, next, entries;
+	unsigned int i;
+
+	head = __atomic_load_n(&r->cons.head, __ATOMIC_RELAXED);
+	do{
+		entries = __atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE) - head;
+		if(unlikely(n>entries)){
+			return 0;
+		}
+		next = head + n;
+	}while(!__atomic_compare_exchange_n(&r->cons.head, &head, next, 0,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	for(i=0;i<n;i++){
+		objs[i] = r->slots[(head+i)&r->mask];
+	}
+	__rte_ring_update_tail(&r->cons, head, next);
+	return n;
+}
+
+#endif
@@ -1,14 +1,12 @@
 #include <stdio.h>
+#include <string.h>
 #include "rte_buddy.h"
 #include "rte_slub.h"
+#include "rte_cycles.h"
+#include "rte_prof.h"
 
 static struct rte_mem_cache *global_mem_caches;
-
-/* 返回所在Core的序号。用于访问slub系统中为每个Core都准备的本地缓存 */
-static inline int rte_get_self_id(void)
-{
-	return 0;
-}
+static int global_mem_cache_num;
 
 static inline struct mem_cache_cpu *get_cpu_slab(struct rte_mem_cache *s)
 {
@@ -43,64 +41,143 @@ static inline int rte_calc_order(int size)
 	return order;
 }
 
-static inline unsigned long rte_oo_make(int order, unsigned long size)
+#define stat_inc(s, item) __atomic_fetch_add(&(s)->stat.item, 1, __ATOMIC_RELAXED)
+
+/*
+ * 编译时定义RTE_SLUB_LATENCY后，按cache、Core和路径记录每次分配/释放的TSC周期数，
+ * 直方图在cpu_slab_enter()与cpu_slab_exit()之间由所在Core写入
+ * */
+#ifdef RTE_SLUB_LATENCY
+#define lat_start(t) ((t) = rte_rdtsc())
+#define lat_path(c, path) ((c)->lat_path = (path))
+#define lat_record(c, t) rte_lat_record(&(c)->lat[(c)->lat_path], rte_rdtsc()-(t))
+#else
+#define lat_start(t) ((t) = 0)
+#define lat_path(c, path) do{}while(0)
+#define lat_record(c, t) do{(void)(t);}while(0)
+#endif
+
+static inline unsigned int page_color(struct rte_page *page)
 {
-	unsigned long x = {(order<<RTE_OO_SHIFT) + (RTE_PAGE_SIZE<<order)/size};
-	return x;
+	return (page->flags>>RTE_PAGE_COLOR_SHIFT)&RTE_PAGE_COLOR_MASK;
 }
 
-static inline int rte_oo_order(unsigned long x)
+static inline void set_page_color(struct rte_page *page, unsigned int color)
 {
-	return x>>RTE_OO_SHIFT;
+	page->flags &= ~(RTE_PAGE_COLOR_MASK<<RTE_PAGE_COLOR_SHIFT);
+	page->flags |= ((uint64_t)color<<RTE_PAGE_COLOR_SHIFT);
 }
 
-static inline int rte_oo_objects(unsigned long x)
+/* slab中第一个Obj的地址 */
+static inline void *slab_base(struct rte_page *page)
 {
-	return x & RTE_OO_MASK;
+	return rte_page_to_virt(page) + page_color(page)*RTE_SLAB_COLOR_ALIGN;
+}
+
+/* 用slab末尾的剩余空间为新slab选择颜色，剩余空间不足一个cache line时少放一个Obj */
+static void slab_color(struct rte_mem_cache *s, struct rte_page *page, int order)
+{
+	unsigned long left = (RTE_PAGE_SIZE<<order) - page->objects*s->size;
+	unsigned int colors;
+
+	if(left<RTE_SLAB_COLOR_ALIGN){
+		if(page->objects<2){
+			return;
+		}
+		page->objects--;
+		left += s->size;
+	}
+	colors = left/RTE_SLAB_COLOR_ALIGN + 1;
+	if(colors>RTE_PAGE_COLOR_MASK+1){
+		colors = RTE_PAGE_COLOR_MASK + 1;
+	}
+	set_page_color(page, __atomic_fetch_add(&s->color_next, 1, __ATOMIC_RELAXED)%colors);
 }
 
-static struct rte_page *allocate_slab(struct rte_mem_cache *s)
+static struct rte_page *allocate_slab(struct rte_mem_cache *s, unsigned int flags, int format)
 {
 	struct rte_page *page;			
-	int order = rte_oo_order(s->oo); 
-	
-	page = rte_get_pages(order);
+	unsigned long oo = __atomic_load_n(&s->oo, __ATOMIC_RELAXED); // oo可能被rte_slub_tune()修改
+	int order = rte_oo_order(oo); 
+	int objects = rte_oo_objects(oo);
+
+	if(format==RTE_SLAB_BITMAP){ // 位图只有64位
+		while(order>0 && objects>RTE_SLAB_BITMAP_OBJECTS){
+			order--;
+			objects = rte_oo_objects(rte_oo_make(order, s->size));
+		}
+		if(objects>RTE_SLAB_BITMAP_OBJECTS){
+			objects = RTE_SLAB_BITMAP_OBJECTS;
+		}
+	}
+	page = __rte_get_pages(order, flags|RTE_GFP_SLAB);
 	if(NULL==page){
 		return NULL;
 	}
-	page->objects = rte_oo_objects(s->oo);
+	page->objects = objects;
+	if(s->coloring){
+		slab_color(s, page, order);
+	}
+	stat_inc(s, new_slab);
 
 	return page;
 }
 
-static struct rte_page *new_slab(struct rte_mem_cache *s)
+/*
+ * 新建slab时不构造空闲Obj链表，只记录第一个Obj的地址，
+ * 从未分配过的Obj由bump指针按顺序分配，被释放的Obj才进入freelist
+ * */
+static struct rte_page *new_slab(struct rte_mem_cache *s, unsigned int flags)
 {
 	struct rte_page *page;
-	void *start;
-	void *last;
-	void *p;
+	int format = s->format;
 
-	page = allocate_slab(s);
+	page = allocate_slab(s, flags, format);
 	if(NULL==page){
 		goto out;
 	}
 	
 	page->slab = s;
 	__SetPageSlub(page);
-	start = rte_page_to_virt(page);
-	last = start;
-	for_each_object(p, s, start, page->objects){
-		set_freepointer(s, last, p);
-		last = p;
+	if(format==RTE_SLAB_BITMAP){ // 位图格式不使用bump指针，所有Obj的位都置1
+		__SetPageSlubBitmap(page);
+		page->free_map = page->objects<64 ? (1UL<<page->objects)-1 : ~0UL;
+		page->bump = NULL;
+	}else{
+		page->freelist = NULL;
+		page->bump = slab_base(page);
 	}
-	set_freepointer(s, last, NULL);
-	
-	page->freelist = start;
 	page->inuse = 0;
 out:
 	return page;
 }
 
+/* slab中还有空闲Obj(在freelist中或尚未分配过) */
+static inline int slab_has_free(struct rte_page *page)
+{
+	return (page->freelist || page->bump);
+}
+
+static inline void *slab_end(struct rte_mem_cache *s, struct rte_page *page)
+{
+	return slab_base(page) + page->objects*s->size;
+}
+
+/* 位图格式的slab中Obj的序号，size为2的幂，不需要除法 */
+static inline unsigned int slab_index(struct rte_mem_cache *s, void *base, void *object)
+{
+	return (object - base)>>s->shift;
+}
+
+/* 取出位图中最低位的空闲Obj */
+static inline void *map_pop(struct rte_mem_cache *s, void *base, uint64_t *map)
+{
+	void *object = base + ((uint64_t)__builtin_ctzll(*map)<<s->shift);
+
+	*map &= *map - 1;
+	return object;
+}
+
 static struct rte_mem_cache *get_slab(uint32_t size)
 {
 	struct rte_mem_cache *s;	
@@ -151,62 +228,113 @@ static inline struct mem_cache_node *get_node(struct rte_mem_cache *s)
 	return &(s->local_node);
 }
 
-static void free_slab(struct rte_mem_cache *s, struct rte_page *page)
+/* 清除slab的标记，之后页可以归还给Buddy系统 */
+static inline void clear_slab(struct rte_page *page)
 {
 	__ClearPageSlub(page);	
-	rte_free_pages(page);
+	__ClearPageSampled(page);
+	__ClearPageSlubBitmap(page);
+	set_page_color(page, 0);
+}
+
+static void free_slab(struct rte_mem_cache *s, struct rte_page *page)
+{
+	clear_slab(page);
+	__rte_free_pages(page);
 }
 
 
 static void discard_slab(struct rte_mem_cache *s, struct rte_page *page)
 {
+	stat_inc(s, discard);
 	free_slab(s, page);
 }
 
+static inline void node_lock(struct mem_cache_node *n)
+{
+	rte_lock_lock(RTE_NODE_LOCK, &n->list_lock);
+}
+
+static inline void node_unlock(struct mem_cache_node *n)
+{
+	rte_lock_unlock(RTE_NODE_LOCK, &n->list_lock);
+}
+
+/* 按使用率计算页所在的partial桶, 桶0为空页 */
+static inline int partial_bucket(struct rte_page *page, unsigned int inuse)
+{
+	return inuse*RTE_PARTIAL_BUCKETS/page->objects;
+}
+
 static void add_partial(struct mem_cache_node *n, struct rte_page *page, int tail)
 {
-	rte_spinlock_lock(&n->list_lock);			
+	struct list_head *head = &n->partial[partial_bucket(page, page->inuse)];
+
+	node_lock(n);			
 	n->nr_partial++;
 	if(tail){
-		list_add_tail(&page->lru, &n->partial);
+		list_add_tail(&page->lru, head);
 	}else{
-		list_add(&page->lru, &n->partial);
+		list_add(&page->lru, head);
 	}
-	rte_spinlock_unlock(&n->list_lock);
+	node_unlock(n);
 	return;
 }
 
+/* partial链表中的页释放了一个Obj后，若使用率跨过了桶的边界，则移到对应的桶中 */
+static void rebucket_partial(struct mem_cache_node *n, struct rte_page *page)
+{
+	int bucket = partial_bucket(page, page->inuse);
+
+	if(bucket==partial_bucket(page, page->inuse+1)){
+		return;
+	}
+	node_lock(n);
+	list_del(&page->lru);
+	list_add_tail(&page->lru, &n->partial[bucket]);
+	node_unlock(n);
+}
+
 static struct rte_page *get_partial(struct rte_mem_cache *s)
 {
 	struct rte_page *page, *page2;	
 	struct mem_cache_node *n = &s->local_node;	
+	int i;
 
 	if(!n||!n->nr_partial){
 		return NULL;
 	}
-	rte_spinlock_lock(&n->list_lock);
-	list_for_each_entry_safe(page, page2, &n->partial, lru){
-		if(lock_and_freeze_slab(n, page))
-			goto out;
+	node_lock(n);
+	for(i=RTE_PARTIAL_BUCKETS-1; i>=0; i--){ // 从最满的桶开始
+		list_for_each_entry_safe(page, page2, &n->partial[i], lru){
+			if(lock_and_freeze_slab(n, page))
+				goto out;
+		}
 	}
 	page = NULL;
 out:
-	rte_spinlock_unlock(&n->list_lock);
+	node_unlock(n);
 	return page;
 }
 
+/* partial链表中应保留的slab个数，空slab只在超过此值时才归还给Buddy系统 */
+static inline unsigned long keep_partial(struct rte_mem_cache *s)
+{
+	return s->min_partial>s->reserved ? s->min_partial : s->reserved;
+}
+
 static void unfreeze_slab(struct rte_mem_cache *s, struct rte_page *page, int tail)
 {
 	struct mem_cache_node *n = get_node(s);
 
 	__ClearPageSlubFrozen(page);
 	if(page->inuse){
-		if(page->freelist){
+		if(slab_has_free(page)){
 			add_partial(n, page, tail);
 		}
 		slab_unlock(page);
 	}else{
-		if(n->nr_partial < s->min_partial){
+		if(n->nr_partial < keep_partial(s)){
 			add_partial(n, page, 1);
 			slab_unlock(page);
 		}else{
@@ -221,6 +349,12 @@ static void deactive_slab(struct rte_mem_cache *s, struct mem_cache_cpu *c)
 	struct rte_page *page = c->page;	
 	int tail = -1;	
 
+	if(c->map){ // 位图格式: 本Core未用完的空闲Obj还给页
+		page->free_map |= c->map;
+		page->inuse -= __builtin_popcountll(c->map);
+		c->map = 0;
+		tail = 0;
+	}
 	while(unlikely(c->freelist)){
 		void **object;	
 		tail = 0;
@@ -231,6 +365,11 @@ static void deactive_slab(struct rte_mem_cache *s, struct mem_cache_cpu *c)
 		page->freelist = object;
 		page->inuse--;
 	}
+	if(c->bump){ // 未分配过的Obj还给页
+		page->bump = c->bump;
+		page->inuse -= (c->bump_end - c->bump)/s->size;
+		c->bump = NULL;
+	}
 	c->page = NULL;
 	
 	unfreeze_slab(s, page, tail);
@@ -242,24 +381,72 @@ static void flush_slab(struct rte_mem_cache *s, struct mem_cache_cpu *c)
 	deactive_slab(s, c);
 }
 
-static void *__slab_alloc(struct rte_mem_cache *s, struct mem_cache_cpu *c)
+static inline void *cpu_slab_bump(struct rte_mem_cache *s, struct mem_cache_cpu *c)
+{
+	void *object = c->bump;
+
+	c->bump += s->size;
+	if(c->bump>=c->bump_end){
+		c->bump = NULL;
+	}
+	return object;
+}
+
+/*
+ * 把c->page中的空闲Obj全部交给Local slab，调用者持有slab_lock。
+ * 其他Core可能释放了本Page的Obj，页中没有空闲Obj时返回0
+ * */
+static int load_cpu_slab(struct rte_mem_cache *s, struct mem_cache_cpu *c)
+{
+	struct rte_page *page = c->page;
+
+	if(PageSlubBitmap(page)){ // 取走页中的整个位图
+		if(!page->free_map){
+			return 0;
+		}
+		c->map = page->free_map;
+		c->base = slab_base(page);
+		page->free_map = 0;
+	}else{
+		if(!page->freelist && !page->bump){
+			return 0;
+		}
+		c->freelist = page->freelist;
+		page->freelist = NULL;
+		if(page->bump){ // 页中未分配过的Obj也交给Local slab
+			c->bump = page->bump;
+			c->bump_end = slab_end(s, page);
+			page->bump = NULL;
+		}
+	}
+	page->inuse = page->objects;
+	return 1;
+}
+
+static void *__slab_alloc(struct rte_mem_cache *s, struct mem_cache_cpu *c, unsigned int flags)
 {
 	void **object;
 	struct rte_page *new;	
 
+	stat_inc(s, alloc_slow);
+	lat_path(c, RTE_LAT_PARTIAL);
 	if(!c->page){//还没有给Local slab分配page
 		goto new_slab;
 	}
 
 	slab_lock(c->page);
 load_freelist: 
-	object = c->page->freelist;//其他Core可能释放了本Page的Obj
-	if(unlikely(!object)){
+	if(unlikely(!load_cpu_slab(s, c))){
 		goto another_slab;
 	}
-	c->freelist = get_freepointer(s, object);
-	c->page->inuse = c->page->objects;
-	c->page->freelist = NULL;
+	if(c->map){
+		object = map_pop(s, c->base, &c->map);
+	}else if(c->freelist){
+		object = c->freelist;
+		c->freelist = get_freepointer(s, object);
+	}else{
+		object = cpu_slab_bump(s, c);
+	}
 
 	slab_unlock(c->page);
 	return object;
@@ -273,9 +460,10 @@ new_slab:
 		goto load_freelist;
 	}
 
-	new = new_slab(s);
+	new = new_slab(s, flags);
 	if(new){
 		c = get_cpu_slab(s);
+		lat_path(c, rte_buddy_split ? RTE_LAT_BUDDY_SPLIT : RTE_LAT_NEW_SLAB);
 		if(c->page){ // 
 			flush_slab(s, c);
 		}
@@ -287,23 +475,72 @@ new_slab:
 	return NULL;
 }
 
-static void *slab_alloc(struct rte_mem_cache *s)
+/*
+ * 所在Core使用mem_cache_cpu前后调用，与维护线程中的flush_idle_cpu_slab()互斥。
+ * 维护线程在设置flush_claim后通过membarrier保证两边的读写顺序，
+ * 因此这里只需要编译器屏障，快速路径上没有原子操作
+ * */
+static inline void cpu_slab_enter(struct mem_cache_cpu *c)
+{
+	c->active = 1;
+	__asm__ __volatile__("" ::: "memory");
+	while(unlikely(c->flush_claim)){
+		c->active = 0;
+		while(__atomic_load_n(&c->flush_claim, __ATOMIC_ACQUIRE)){
+			rte_pause();
+		}
+		c->active = 1;
+		__asm__ __volatile__("" ::: "memory");
+	}
+}
+
+static inline void cpu_slab_exit(struct mem_cache_cpu *c)
+{
+	__asm__ __volatile__("" ::: "memory");
+	c->active = 0;
+}
+
+static void *slab_alloc(struct rte_mem_cache *s, unsigned int flags)
 {
 	void **object;		
 	struct mem_cache_cpu *c;
+	uint64_t t0;
 
+	lat_start(t0);
 	c = get_cpu_slab(s);
+	cpu_slab_enter(c);
+	lat_path(c, RTE_LAT_FAST);
 	object = c->freelist;
-	if(unlikely(NULL==object)){//当前Core的Freelist中没有空闲Obj
-		object = __slab_alloc(s, c);
-	}else{
+	if(likely(object)){
 		c->freelist = get_freepointer(s, object); // 有空闲Obj时，直接分一个
+	}else if(c->map){ // 位图格式的Local slab
+		object = map_pop(s, c->base, &c->map);
+	}else if(c->bump){ // 分配一个从未使用过的Obj
+		object = cpu_slab_bump(s, c);
+	}else{//当前Core的Freelist中没有空闲Obj
+		object = __slab_alloc(s, c, flags);
 	}
+	c->nr_alloc += (object!=NULL);
+	lat_record(c, t0);
+	cpu_slab_exit(c);
 
 	return object;
 }
 
-void *__rte_slub_alloc(uint32_t size)
+/* 被采样的Obj所在的页标记PG_sampled，释放时只有这些页才需要查找采样记录 */
+static void slab_sample(void *ptr, uint32_t size)
+{
+	struct rte_page *page;
+
+	if(rte_prof_sample(ptr, size)){
+		page = rte_virt_to_head_page(ptr);
+		slab_lock(page);
+		__SetPageSampled(page);
+		slab_unlock(page);
+	}
+}
+
+void *__rte_slub_alloc(uint32_t size, unsigned int flags)
 {
 	struct rte_mem_cache *s;	
 	void *ptr;
@@ -312,7 +549,10 @@ void *__rte_slub_alloc(uint32_t size)
 	if(unlikely(NULL==s)){
 		return NULL;
 	}
-	ptr = slab_alloc(s);
+	ptr = slab_alloc(s, flags);
+	if(unlikely((rte_prof_countdown -= size)<0)){
+		slab_sample(ptr, size);
+	}
 
 	return ptr;
 }
@@ -320,24 +560,42 @@ void *__rte_slub_alloc(uint32_t size)
 static void remove_partial(struct rte_mem_cache *s, struct rte_page *page)
 {
 	struct mem_cache_node *n = get_node(s);
-	rte_spinlock_lock(&n->list_lock);
+	node_lock(n);
 	list_del(&page->lru);
 	n->nr_partial--;
-	rte_spinlock_unlock(&n->list_lock);
+	node_unlock(n);
 	return;
 }
 
 static void init_mem_cache_node(struct mem_cache_node *n)
 {
-	rte_spinlock_init(&n->list_lock);	
+	int i;
+
+	rte_lock_init(RTE_NODE_LOCK, &n->list_lock);	
 	n->nr_partial = 0;
-	INIT_LIST_HEAD(&n->partial);
+	for(i=0;i<RTE_PARTIAL_BUCKETS;i++){
+		INIT_LIST_HEAD(&n->partial[i]);
+	}
 }
 
 static void init_mem_cache_cpu(struct mem_cache_cpu *c)
 {
 	c->freelist = NULL;
+	c->bump = NULL;
+	c->bump_end = NULL;
+	c->map = 0;
+	c->base = NULL;
 	c->page = NULL;
+	c->nr_alloc = 0;
+	c->nr_free = 0;
+	c->active = 0;
+	c->flush_claim = 0;
+	c->last_freelist = NULL;
+	c->last_bump = NULL;
+	c->last_map = 0;
+	c->idle_periods = 0;
+	c->primed = 0;
+	c->primed_alloc = 0;
 }
 
 #define MIN_PARTIAL 5
@@ -351,26 +609,635 @@ static void set_min_partial(struct rte_mem_cache *s, unsigned long min)
 	s->min_partial = min;
 }
 
+/*
+ * 计算slab的order, 参考Linux Kernel中的calculate_order():
+ * 在不超过RTE_SLUB_MAX_ORDER的前提下，选取能容纳min_objects个对象、
+ * 且末尾浪费的空间不超过slab大小1/fract_leftover的最小order
+ * */
+#define RTE_SLUB_MAX_ORDER 3
+#define RTE_SLUB_MIN_OBJECTS 4
+static inline int slab_order(int size, int min_objects, int max_order, int fract_leftover)
+{
+	int order;
+	unsigned long slab_size;
+	unsigned long rem;
+
+	for(order=rte_calc_order(min_objects*size); order<=max_order; order++){
+		slab_size = RTE_PAGE_SIZE<<order;
+		if(slab_size<size){
+			continue;
+		}
+		if(slab_size/size>RTE_OO_MASK){
+			break;
+		}
+		rem = slab_size%size;
+		if(rem<=slab_size/fract_leftover){
+			break;
+		}
+	}
+	return order;
+}
+
+static int calculate_order(int size)
+{
+	int order;
+	int min_objects;
+	int fraction;
+
+	min_objects = RTE_SLUB_MIN_OBJECTS;
+	while(min_objects>1){
+		fraction = 16;
+		while(fraction>=4){
+			order = slab_order(size, min_objects, RTE_SLUB_MAX_ORDER, fraction);
+			if(order<=RTE_SLUB_MAX_ORDER){
+				return order;
+			}
+			fraction /= 2;
+		}
+		min_objects--;
+	}
+
+	/* 每个slab中只放一个对象 */
+	order = slab_order(size, 1, RTE_SLUB_MAX_ORDER, 1);
+	if(order<=RTE_SLUB_MAX_ORDER){
+		return order;
+	}
+	order = slab_order(size, 1, RTE_MAX_ORDER-1, 1);
+	if(order<RTE_MAX_ORDER){
+		return order;
+	}
+	return -1;
+}
+
 #define RTE_SLUB_OFFSET 32
 static int init_mem_cache(struct rte_mem_cache *s, int size)
 {
 	int i;
 	int order;
-	order = rte_calc_order(size);
+	order = calculate_order(size);
+	if(order<0){ // 对象大于Buddy系统的最大块
+		order = rte_calc_order(size);
+	}
 	s->size = size;
+	s->shift = rte_fls(size);
+	s->format = RTE_SLAB_FREELIST;
+	s->coloring = 0;
+	s->color_next = 0;
 	s->offset = RTE_SLUB_OFFSET;
 	s->oo = rte_oo_make(order, size);
+	s->base_order = order;
 
-	set_min_partial(s, 5);
+	set_min_partial(s, rte_fls(size)/2);
+	s->reserved = 0;
 	init_mem_cache_node(&s->local_node);
+	s->mobility = NULL;
 
 	for(i=0;i<RTE_MAX_CPU_NUM;i++){
 		init_mem_cache_cpu(s->cpu_slab+i);
 	}
+	memset(&s->stat, 0, sizeof(s->stat));
+
+	return 0;
+}
+
+/* 释放partial链表中超出min_partial的空slab，每RTE_SHRINK_BATCH个slab批量归还一次 */
+#define RTE_SHRINK_BATCH 32
+static void shrink_partial(struct rte_mem_cache *s)
+{
+	struct mem_cache_node *n = get_node(s);
+	struct rte_page *page, *page2;
+	struct rte_page *bulk[RTE_SHRINK_BATCH];
+	unsigned int nr=0;
+	LIST_HEAD(discard);
+
+	node_lock(n);
+	list_for_each_entry_safe(page, page2, &n->partial[0], lru){
+		if(n->nr_partial<=keep_partial(s)){
+			break;
+		}
+		if(!page->inuse && slab_trylock(page)){
+			if(!page->inuse){
+				list_del(&page->lru);
+				n->nr_partial--;
+				list_add(&page->lru, &discard);
+			}
+			slab_unlock(page);
+		}
+	}
+	node_unlock(n);
+
+	list_for_each_entry_safe(page, page2, &discard, lru){
+		list_del(&page->lru);
+		stat_inc(s, discard);
+		clear_slab(page);
+		bulk[nr++] = page;
+		if(nr==RTE_SHRINK_BATCH){
+			__rte_free_pages_bulk(bulk, nr);
+			nr = 0;
+		}
+	}
+	if(nr){
+		__rte_free_pages_bulk(bulk, nr);
+	}
+}
+
+/*
+ * Slab整理: 使用率低于1/RTE_DEFRAG_RATIO的partial slab作为源，其中的Obj被移到比它更满的
+ * partial slab中。只使用partial链表中已有的空闲Obj，不为整理分配新的slab，
+ * 也不使用各Core的Local slab，因此可以在维护线程中执行
+ * */
+#define RTE_DEFRAG_RATIO 4
+#define RTE_DEFRAG_BATCH 16 // 每个cache一次最多整理的slab个数
+#define RTE_DEFRAG_MAX_OBJECTS ((RTE_PAGE_SIZE<<RTE_SLUB_MAX_ORDER)/RTE_SLAB_BASE_SIZE)
+
+static void __slab_free(struct rte_mem_cache *s, struct rte_page *page, void *p);
+
+/* 从inuse大于min_inuse的partial slab中分配一个Obj，优先选最满的slab */
+static void *defrag_alloc(struct rte_mem_cache *s, unsigned int min_inuse)
+{
+	struct mem_cache_node *n = get_node(s);
+	struct rte_page *page;
+	void **object=NULL;
+	int i;
+
+	node_lock(n);
+	for(i=RTE_PARTIAL_BUCKETS-1; i>=0 && !object; i--){
+		list_for_each_entry(page, &n->partial[i], lru){
+			if(page->inuse<=min_inuse||!slab_trylock(page)){
+				continue;
+			}
+			if(PageSlubBitmap(page)){
+				object = page->free_map ? map_pop(s, slab_base(page), &page->free_map) : NULL;
+			}else if((object = page->freelist)){
+				page->freelist = get_freepointer(s, object);
+			}else if(page->bump){
+				object = page->bump;
+				page->bump += s->size;
+				if(page->bump>=slab_end(s, page)){
+					page->bump = NULL;
+				}
+			}
+			if(object){
+				page->inuse++;
+				list_del(&page->lru);
+				if(slab_has_free(page)){
+					list_add(&page->lru, &n->partial[partial_bucket(page, page->inuse)]);
+				}else{
+					n->nr_partial--;
+				}
+			}
+			slab_unlock(page);
+			if(object){
+				break;
+			}
+		}
+	}
+	node_unlock(n);
+	return object;
+}
+
+/* 在slab被冻结且加锁时，找出其中在用的Obj */
+static unsigned int defrag_live_objects(struct rte_mem_cache *s, struct rte_page *page, void **live)
+{
+	uint64_t free[RTE_DEFRAG_MAX_OBJECTS/64] = {0};
+	void *addr = slab_base(page);
+	void **p;
+	unsigned int i, nr=0, end;
+
+	if(PageSlubBitmap(page)){
+		free[0] = page->free_map;
+		p = NULL;
+	}else{
+		p = page->freelist;
+	}
+	for(; p; p=get_freepointer(s, p)){
+		i = ((void *)p - addr)/s->size;
+		free[i/64] |= 1UL<<(i%64);
+	}
+	end = page->bump ? (page->bump - addr)/s->size : page->objects;
+	for(i=0; i<end; i++){
+		if(!(free[i/64]&(1UL<<(i%64)))){
+			live[nr++] = addr + i*s->size;
+		}
+	}
+	return nr;
+}
+
+/* 把一个冻结的slab中的Obj全部移走，成功时返回1，slab已归还给Buddy系统 */
+static int defrag_slab(struct rte_mem_cache *s, const struct rte_slub_mobility *ops,
+				struct rte_page *page)
+{
+	void *live[RTE_DEFRAG_MAX_OBJECTS];
+	void *to;
+	unsigned int i, j, nr;
+
+	nr = defrag_live_objects(s, page, live);
+	slab_unlock(page);
+
+	for(i=0; i<nr; i++){
+		if(ops->isolate(live[i], ops->arg)){
+			break;
+		}
+	}
+	if(i<nr){ // 有Obj不能移动时slab无法被清空，放弃整个slab
+		for(j=0; j<i; j++){
+			ops->putback(live[j], ops->arg);
+		}
+		goto out;
+	}
+	for(i=0; i<nr; i++){
+		to = defrag_alloc(s, nr);
+		if(NULL==to){
+			for(j=i; j<nr; j++){
+				ops->putback(live[j], ops->arg);
+			}
+			goto out;
+		}
+		ops->migrate(live[i], to, s->size, ops->arg);
+		if(unlikely(PageSampled(page))){
+			rte_prof_free(live[i]);
+		}
+		__slab_free(s, page, live[i]); // slab被冻结，Obj只回到页的freelist中
+	}
+
+out:
+	slab_lock(page);
+	if(!page->inuse && get_node(s)->nr_partial>=keep_partial(s)){
+		__ClearPageSlubFrozen(page);
+		slab_unlock(page);
+		stat_inc(s, defrag);
+		discard_slab(s, page);
+		return 1;
+	}
+	unfreeze_slab(s, page, 1);
+	return 0;
+}
+
+static int defrag_mem_cache(struct rte_mem_cache *s)
+{
+	const struct rte_slub_mobility *ops = __atomic_load_n(&s->mobility, __ATOMIC_ACQUIRE);
+	struct mem_cache_node *n = get_node(s);
+	struct rte_page *page, *page2;
+	int nr=0, batch;
+
+	if(NULL==ops||rte_oo_objects(s->oo)<2){
+		return 0;
+	}
+	for(batch=0; batch<RTE_DEFRAG_BATCH; batch++){
+		node_lock(n);
+		list_for_each_entry_safe(page, page2, &n->partial[0], lru){
+			if(page->inuse && page->inuse*RTE_DEFRAG_RATIO<page->objects &&
+			   page->objects<=RTE_DEFRAG_MAX_OBJECTS && lock_and_freeze_slab(n, page)){
+				goto found;
+			}
+		}
+		node_unlock(n);
+		break;
+found:
+		node_unlock(n);
+		nr += defrag_slab(s, ops, page);
+	}
+	return nr;
+}
+
+/*
+ * 根据两次调用之间慢速路径的统计调整一个cache:
+ * 	频繁创建slab的cache增大slab的order，减少进入慢速路径的次数;
+ * 	刚释放的slab又被重新分配的cache增大min_partial，避免与Buddy系统反复交换页;
+ * 	空闲的cache逐步恢复原来的order, 减小min_partial并释放多余的空slab
+ * */
+#define RTE_TUNE_HOT_SLABS 32 // 一个周期内新建slab的个数超过此值时，认为cache是热的
+#define RTE_TUNE_MIN_PARTIAL 1
+static void tune_mem_cache(struct rte_mem_cache *s)
+{
+	uint64_t alloc_slow = __atomic_load_n(&s->stat.alloc_slow, __ATOMIC_RELAXED);
+	uint64_t nr_new = __atomic_load_n(&s->stat.new_slab, __ATOMIC_RELAXED);
+	uint64_t nr_discard = __atomic_load_n(&s->stat.discard, __ATOMIC_RELAXED);
+	uint64_t d_slow = alloc_slow - s->stat.last_alloc_slow;
+	uint64_t d_new = nr_new - s->stat.last_new_slab;
+	uint64_t d_discard = nr_discard - s->stat.last_discard;
+	int order = rte_oo_order(s->oo);
+
+	s->stat.last_alloc_slow = alloc_slow;
+	s->stat.last_new_slab = nr_new;
+	s->stat.last_discard = nr_discard;
+
+	if(!d_slow){
+		if(order>s->base_order){
+			__atomic_store_n(&s->oo, rte_oo_make(order-1, s->size), __ATOMIC_RELAXED);
+		}
+		if(s->min_partial>RTE_TUNE_MIN_PARTIAL){
+			s->min_partial--;
+		}
+		shrink_partial(s);
+		return;
+	}
+
+	if(d_new>=RTE_TUNE_HOT_SLABS && order<RTE_SLUB_MAX_ORDER &&
+	   (RTE_PAGE_SIZE<<(order+1))/s->size<=RTE_OO_MASK){
+		__atomic_store_n(&s->oo, rte_oo_make(order+1, s->size), __ATOMIC_RELAXED);
+	}
+	if(d_discard && d_discard*2>=d_new && s->min_partial<MAX_PARTIAL){
+		s->min_partial++;
+	}
+}
+
+/* 对所有cache进行一次调优，由使用者周期性地调用 */
+void rte_slub_tune(void)
+{
+	int i;
+
+	for(i=0;i<global_mem_cache_num;i++){
+		tune_mem_cache(global_mem_caches+i);
+	}
+}
+
+/*
+ * 清空一个长时间没有分配/释放的Core的Local slab，使其中的空闲Obj
+ * 回到partial链表，空页能被归还给Buddy系统。
+ * Local slab的freelist连续RTE_MAINT_IDLE_PERIODS个周期没有变化时认为Core空闲。
+ * barrier必须保证所有线程都执行了一次内存屏障(如membarrier)
+ * */
+#define RTE_MAINT_IDLE_PERIODS 3
+static void flush_idle_cpu_slab(struct rte_mem_cache *s, struct mem_cache_cpu *c,
+				void (*barrier)(void))
+{
+	void **freelist = c->freelist;
+	void *bump = c->bump;
+	uint64_t map = c->map;
+
+	if(!c->page){
+		c->idle_periods = 0;
+		return;
+	}
+	if(c->primed){ // 预热的Local slab保留到本Core第一次分配之后
+		if(__atomic_load_n(&c->nr_alloc, __ATOMIC_RELAXED)==c->primed_alloc){
+			c->idle_periods = 0;
+			return;
+		}
+		c->primed = 0;
+	}
+	if(freelist!=c->last_freelist||bump!=c->last_bump||map!=c->last_map){
+		c->last_freelist = freelist;
+		c->last_bump = bump;
+		c->last_map = map;
+		c->idle_periods = 0;
+		return;
+	}
+	if(++c->idle_periods<RTE_MAINT_IDLE_PERIODS){
+		return;
+	}
+
+	c->flush_claim = 1;
+	barrier();
+	if(!c->active && c->page){
+		flush_slab(s, c);
+	}
+	c->last_freelist = NULL;
+	c->last_bump = NULL;
+	c->last_map = 0;
+	c->idle_periods = 0;
+	__atomic_store_n(&c->flush_claim, 0, __ATOMIC_RELEASE);
+}
+
+/* 释放所有cache中超出min_partial的空slab，可在内存压力回调中调用 */
+void rte_slub_shrink(void)
+{
+	int i;
+
+	for(i=0;i<global_mem_cache_num;i++){
+		shrink_partial(global_mem_caches+i);
+	}
+}
+
+/*
+ * 后台维护，由维护线程周期性地调用:
+ * 清空空闲Core的Local slab，释放多余的空slab，并调整各cache的order与min_partial。
+ * barrier为NULL时不清空Local slab
+ * */
+void rte_slub_maintain(void (*barrier)(void))
+{
+	struct rte_mem_cache *s;
+	int i, j;
+
+	for(i=0;i<global_mem_cache_num;i++){
+		s = global_mem_caches + i;
+		if(barrier){
+			for(j=0;j<RTE_MAX_CPU_NUM;j++){
+				flush_idle_cpu_slab(s, s->cpu_slab+j, barrier);
+			}
+		}
+		shrink_partial(s);
+		defrag_mem_cache(s);
+	}
+	rte_slub_tune();
+}
+
+/* 为size所在规格的cache设置迁移回调，ops为NULL时取消。ops在设置期间必须保持有效 */
+int rte_slub_set_mobility(uint32_t size, const struct rte_slub_mobility *ops)
+{
+	struct rte_mem_cache *s = get_slab(size);
+
+	if(NULL==s||(ops&&(!ops->isolate||!ops->migrate||!ops->putback))){
+		return -1;
+	}
+	__atomic_store_n(&s->mobility, ops, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* 设置size所在规格的cache之后新建slab的格式，已有的slab保持原来的格式 */
+int rte_slub_set_format(uint32_t size, int format)
+{
+	struct rte_mem_cache *s = get_slab(size);
+
+	if(NULL==s||(format!=RTE_SLAB_FREELIST&&format!=RTE_SLAB_BITMAP)){
+		return -1;
+	}
+	__atomic_store_n(&s->format, format, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * 开启或关闭size所在规格的cache的着色，只影响之后新建的slab。
+ * 开启时把slab增大到至少RTE_COLOR_MIN_OBJECTS个Obj，RTE_SLUB_MAX_ORDER以内做不到时返回-1。
+ * 关闭时base_order恢复为calculate_order()的结果，已增大的order由调优逐步降回
+ * */
+int rte_slub_set_coloring(uint32_t size, int on)
+{
+	struct rte_mem_cache *s = get_slab(size);
+	int order;
+
+	if(NULL==s){
+		return -1;
+	}
+	if(!on){
+		order = calculate_order(s->size);
+		if(order>=0){
+			s->base_order = order;
+		}
+	}else{
+		order = s->base_order;
+		while(order<RTE_SLUB_MAX_ORDER && (RTE_PAGE_SIZE<<order)/s->size<RTE_COLOR_MIN_OBJECTS){
+			order++;
+		}
+		if((RTE_PAGE_SIZE<<order)/s->size<RTE_COLOR_MIN_OBJECTS){
+			return -1;
+		}
+		s->base_order = order;
+		if(rte_oo_order(s->oo)<order){
+			__atomic_store_n(&s->oo, rte_oo_make(order, s->size), __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_store_n(&s->coloring, !!on, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * 为size所在规格的cache预先新建能容纳n_objects个Obj的slab，放入partial链表。
+ * 预留的slab计入cache->reserved，不会被min_partial的收缩归还给Buddy系统。
+ * 可多次调用累加预留，n_objects为0时取消预留(已有的slab之后按min_partial收缩)
+ * */
+int rte_mem_cache_reserve(uint32_t size, uint32_t n_objects)
+{
+	struct rte_mem_cache *s = get_slab(size);
+	struct rte_page *page, *next;
+	uint32_t nr=0;
+	LIST_HEAD(pages);
 
+	if(NULL==s){
+		return -1;
+	}
+	if(!n_objects){
+		__atomic_store_n(&s->reserved, 0, __ATOMIC_RELAXED);
+		return 0;
+	}
+	/* 全部新建成功后才放入partial链表，失败时归还本次新建的slab */
+	while(nr<n_objects){
+		page = new_slab(s, 0);
+		if(NULL==page){
+			list_for_each_entry_safe(page, next, &pages, lru){
+				list_del(&page->lru);
+				free_slab(s, page);
+			}
+			return -1;
+		}
+		nr += page->objects;
+		list_add_tail(&page->lru, &pages);
+	}
+	list_for_each_entry_safe(page, next, &pages, lru){
+		list_del(&page->lru);
+		__atomic_fetch_add(&s->reserved, 1, __ATOMIC_RELAXED);
+		add_partial(get_node(s), page, 1);
+	}
 	return 0;
 }
 
+/*
+ * 为Core 0到cores-1中还没有Local slab的Core装载一个slab(优先取partial链表中的slab)，
+ * 使这些Core的第一次分配就走快速路径。修改的是其他Core的mem_cache_cpu，
+ * 必须在这些Core开始分配之前调用。维护线程在这些Core第一次分配之前不会把它们当作空闲而清空
+ * */
+int rte_mem_cache_prime(uint32_t size, int cores)
+{
+	struct rte_mem_cache *s = get_slab(size);
+	struct mem_cache_cpu *c;
+	struct rte_page *page;
+	int i;
+
+	if(NULL==s||cores<0||cores>RTE_MAX_CPU_NUM){
+		return -1;
+	}
+	for(i=0;i<cores;i++){
+		c = s->cpu_slab + i;
+		if(c->page){
+			continue;
+		}
+		page = get_partial(s);
+		if(NULL==page){
+			page = new_slab(s, 0);
+			if(NULL==page){
+				return -1;
+			}
+			slab_lock(page);
+			__SetPageSlubFrozen(page);
+		}
+		c->page = page;
+		load_cpu_slab(s, c);
+		slab_unlock(page);
+		c->primed_alloc = c->nr_alloc;
+		c->primed = 1;
+	}
+	return 0;
+}
+
+/*
+ * 启动时预热: 按res为各规格预留slab，再用预留的slab装载cores个Core的Local slab
+ * */
+int rte_slub_prewarm(const struct rte_mem_reserve *res, int nr, int cores)
+{
+	int i;
+
+	for(i=0;i<nr;i++){
+		if(rte_mem_cache_reserve(res[i].size, res[i].objects)<0||
+		   rte_mem_cache_prime(res[i].size, cores)<0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * 整理size所在规格的cache，size为0时整理所有设置了迁移回调的cache。
+ * 返回归还给Buddy系统的slab个数
+ * */
+int rte_slub_defrag(uint32_t size)
+{
+	struct rte_mem_cache *s;
+	int i, nr=0;
+
+	if(size){
+		s = get_slab(size);
+		return s ? defrag_mem_cache(s) : -1;
+	}
+	for(i=0;i<global_mem_cache_num;i++){
+		nr += defrag_mem_cache(global_mem_caches+i);
+	}
+	return nr;
+}
+
+struct rte_mem_cache *rte_slub_caches(int *cache_num)
+{
+	*cache_num = global_mem_cache_num;
+	return global_mem_caches;
+}
+
+/*
+ * 把各Core记录的直方图相加到hist中。读取时不暂停各Core，
+ * 得到的是近似的快照。未定义RTE_SLUB_LATENCY时返回-1
+ * */
+int rte_slub_latency(struct rte_mem_cache *s, int path, struct rte_lat_hist *hist)
+{
+#ifdef RTE_SLUB_LATENCY
+	int i, j;
+
+	memset(hist, 0, sizeof(*hist));
+	if(path<0||path>=RTE_LAT_PATH_NUM){
+		return -1;
+	}
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		for(j=0;j<RTE_LAT_BUCKETS;j++){
+			hist->count[j] += *(volatile uint64_t *)&s->cpu_slab[i].lat[path].count[j];
+		}
+	}
+	return 0;
+#else
+	(void)s;
+	(void)path;
+	memset(hist, 0, sizeof(*hist));
+	return -1;
+#endif
+}
+
 int rte_slub_system_init(struct rte_mem_cache *array, int cache_num)
 {
 	int i;
@@ -378,6 +1245,7 @@ int rte_slub_system_init(struct rte_mem_cache *array, int cache_num)
 	int size;
 	
 	global_mem_caches = array;
+	global_mem_cache_num = cache_num;
 	for(i=0;i<cache_num;i++){
 		s = array + i;
 		size = RTE_SLAB_BASE_SIZE * (1<<i);
@@ -386,26 +1254,67 @@ int rte_slub_system_init(struct rte_mem_cache *array, int cache_num)
 	return 0;
 }
 
+/*
+ * 重新使用持久内存池中上一个进程留下的cache，各Core的Local slab与partial链表都保留，
+ * 因此不需要重新预热。只重置锁与维护线程使用的状态
+ * */
+int rte_slub_system_attach(struct rte_mem_cache *array, int cache_num)
+{
+	struct mem_cache_cpu *c;
+	int i, j;
+
+	for(i=0;i<cache_num;i++){
+		if(array[i].size!=RTE_SLAB_BASE_SIZE*(1<<i)){
+			return -1;
+		}
+	}
+	global_mem_caches = array;
+	global_mem_cache_num = cache_num;
+	for(i=0;i<cache_num;i++){
+		rte_lock_init(RTE_NODE_LOCK, &array[i].local_node.list_lock);
+		array[i].mobility = NULL; // 回调函数的地址在新进程中无效
+		for(j=0;j<RTE_MAX_CPU_NUM;j++){
+			c = array[i].cpu_slab + j;
+			c->active = 0;
+			c->flush_claim = 0;
+			c->last_freelist = NULL;
+			c->last_bump = NULL;
+			c->last_map = 0;
+			c->idle_periods = 0;
+		}
+	}
+	return 0;
+}
+
 static void __slab_free(struct rte_mem_cache *s, struct rte_page *page, void *p)
 {
 	void *prior;
+	int was_full;
 	void **object = (void *)p;
 
 	slab_lock(page);
-	prior = page->freelist;
-	set_freepointer(s, object, prior);
-	page->freelist = object;
+	was_full = !slab_has_free(page);
+	if(PageSlubBitmap(page)){ // 只修改页描述符中的位图，不写Obj
+		page->free_map |= 1UL<<slab_index(s, slab_base(page), p);
+	}else{
+		prior = page->freelist;
+		set_freepointer(s, object, prior);
+		page->freelist = object;
+	}
 	page->inuse--;
 	if(unlikely(PageSlubFrozen(page))){
 		goto out_unlock;
 	}
 	
-	if(unlikely(!page->inuse)){
+	/* 空slab在partial链表中保留min_partial个，避免与Buddy系统反复交换页 */
+	if(unlikely(!page->inuse) && get_node(s)->nr_partial>=keep_partial(s)){
 		goto slab_empty;
 	}
 
-	if(unlikely(!prior)){
+	if(unlikely(was_full)){
 		add_partial(get_node(s), page, 1);
+	}else{
+		rebucket_partial(get_node(s), page);
 	}
 
 out_unlock:
@@ -413,7 +1322,7 @@ out_unlock:
 	return;
 
 slab_empty:
-	if(prior){
+	if(!was_full){
 		remove_partial(s, page);
 	}
 	slab_unlock(page);
@@ -427,14 +1336,25 @@ static void slab_free(struct rte_mem_cache *s, struct rte_page *page, void *p)
 {
 	void **object = (void *)p;
 	struct mem_cache_cpu *c;
+	uint64_t t0;
 
+	lat_start(t0);
 	c = get_cpu_slab(s);
+	cpu_slab_enter(c);
 	if(likely(page==c->page)){ // 当页正作为Local slab时
-		set_freepointer(s, object, c->freelist);
-		c->freelist = object;
+		if(PageSlubBitmap(page)){
+			c->map |= 1UL<<slab_index(s, c->base, object);
+		}else{
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+		}
 	}else{
 		__slab_free(s, page, p);
+		lat_path(c, RTE_LAT_REMOTE_FREE);
+		lat_record(c, t0);
 	}
+	c->nr_free++;
+	cpu_slab_exit(c);
 	return ;
 }
 
@@ -452,6 +1372,9 @@ void  __rte_slub_free(void *ptr)
 		RTE_SLUB_BUG(__FILE__, __LINE__);		
 		return;
 	}
+	if(unlikely(PageSampled(page))){
+		rte_prof_free(object);
+	}
 
 	slab_free(page->slab, page, object);
 	return ;
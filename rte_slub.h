@@ -5,16 +5,48 @@
 #include "rte_types.h"
 #include "rte_list.h"
 #include "rte_spinlock.h"
+#include "rte_lcore.h"
+#include "rte_buddy.h"
+#include "rte_latency.h"
 
 struct mem_cache_cpu{
 	void **freelist; // 指向本地Local slab的空闲Obj链表
+	void *bump; // Local slab中尚未被分配过的Obj，freelist为空时按顺序分配
+	void *bump_end;
+	uint64_t map; // 位图格式的Local slab中本Core可用的空闲Obj
+	void *base; // 位图格式的Local slab中第一个Obj的地址
 	struct rte_page *page;
+	uint64_t nr_alloc; // 本Core分配与释放的Obj个数，只由本Core修改
+	uint64_t nr_free;
+	volatile int active; // 所在Core正在使用本结构
+	volatile int flush_claim; // 维护线程正在清空本Core的Local slab
+	void **last_freelist; // 以下由维护线程使用，用于判断Core是否空闲
+	void *last_bump;
+	uint64_t last_map;
+	uint32_t idle_periods;
+	int primed; // 由rte_mem_cache_prime()装载，本Core开始分配之前不清空
+	uint64_t primed_alloc; // 装载时的nr_alloc
+#ifdef RTE_SLUB_LATENCY
+	uint32_t lat_path; // 本次操作所走的路径，见enum rte_lat_path
+	struct rte_lat_hist lat[RTE_LAT_PATH_NUM]; // 只由本Core写入
+#endif
 };
 
+/* mem_cache_node.list_lock所用锁的类型: spinlock, ticketlock或mcslock */
+#ifndef RTE_NODE_LOCK
+#define RTE_NODE_LOCK spinlock
+#endif
+
+/*
+ * partial链表按页的使用率(inuse/objects)分为若干桶，
+ * 分配时优先从最满的桶中取页，使较空的页能尽快被释放回Buddy系统
+ * */
+#define RTE_PARTIAL_BUCKETS 4
+
 struct mem_cache_node{
-	rte_spinlock_t list_lock;
+	RTE_LOCK_T(RTE_NODE_LOCK) list_lock;
 	unsigned long nr_partial;
-	struct list_head partial;
+	struct list_head partial[RTE_PARTIAL_BUCKETS];
 };
 
 #define RTE_SLAB_BASE_SIZE 64
@@ -22,16 +54,77 @@ struct mem_cache_node{
 #define RTE_OO_SHIFT 16
 #define RTE_OO_MASK ((1UL<<RTE_OO_SHIFT)-1)
 
-#define RTE_MAX_CPU_NUM 8
+/*
+ * 慢速路径的统计，供rte_slub_tune()根据两次调用之间的增量调整
+ * slab的order与min_partial
+ * */
+struct mem_cache_stat{
+	uint64_t alloc_slow; // 进入__slab_alloc的次数
+	uint64_t new_slab; // 从Buddy系统分配slab的次数
+	uint64_t discard; // 归还给Buddy系统的slab个数
+	uint64_t defrag; // 其中由rte_slub_defrag()移走所有Obj后归还的slab个数
+	uint64_t last_alloc_slow; // 上次调优时的快照
+	uint64_t last_new_slab;
+	uint64_t last_discard;
+};
+
+/*
+ * Obj迁移回调(isolate/migrate模式)。稀疏的slab中只剩少数长期存活的Obj时，整理过程
+ * 先对slab中每个在用的Obj调用isolate，全部成功后再为每个Obj从较满的slab中分配新位置，
+ * 调用migrate把内容与所有引用转移到新Obj，最后把空出的slab归还给Buddy系统。
+ * 同一规格的cache可能被多个使用者共享，isolate对不属于自己或不能移动的Obj必须返回非0。
+ * 	isolate: 返回0表示Obj已被固定，在migrate或putback之前使用者不会访问或释放它
+ * 	migrate: 把from的内容复制到to并更新所有引用，之后from由分配器释放
+ * 	putback: 放弃迁移，解除isolate的固定
+ * 回调在调用rte_slub_defrag()的线程(通常是维护线程)中执行
+ * */
+struct rte_slub_mobility{
+	int (*isolate)(void *obj, void *arg);
+	void (*migrate)(void *from, void *to, uint32_t size, void *arg);
+	void (*putback)(void *obj, void *arg);
+	void *arg;
+};
+
+/*
+ * slab中空闲Obj的记录方式:
+ * 	RTE_SLAB_FREELIST: 空闲Obj组成链表，下一个Obj的地址写在Obj内部(offset处)
+ * 	RTE_SLAB_BITMAP: 空闲Obj记录在页描述符中的64位位图里，用bsf查找空闲Obj，
+ * 	                 分配与释放都不读写Obj本身，远程释放不会弄脏冷的Obj所在的cache line。
+ * 	                 每个slab最多64个Obj，必要时使用较小的order
+ * 格式记录在每个slab的页上(PG_slub_bitmap)，修改cache的格式只影响之后新建的slab
+ * */
+enum rte_slab_format{
+	RTE_SLAB_FREELIST,
+	RTE_SLAB_BITMAP,
+};
+#define RTE_SLAB_BITMAP_OBJECTS 64
+
+/*
+ * Slab着色(Bonwick): 每个新建的slab的第一个Obj依次偏移0, 1, 2...个cache line，
+ * 使不同slab中相同序号的Obj落在不同的cache组中。各规格都是2的幂，slab末尾通常没有剩余空间，
+ * 因此开启着色的cache在剩余空间不足一个cache line时少放一个Obj，
+ * 并把slab增大到至少RTE_COLOR_MIN_OBJECTS个Obj，使浪费的空间不超过1/RTE_COLOR_MIN_OBJECTS。
+ * 在RTE_SLUB_MAX_ORDER以内放不下这么多Obj的规格(4KB及以上)不能开启着色
+ * */
+#define RTE_SLAB_COLOR_ALIGN 64
+#define RTE_COLOR_MIN_OBJECTS 16
 
 /* 每种规格的slab都对应一个 struct rte_mem_caches 结构体 */
 struct rte_mem_cache{
 	struct mem_cache_cpu cpu_slab[RTE_MAX_CPU_NUM]; // 每个Core对应一个
 	int32_t size; // 本mem_cache中slab的规格
+	int32_t shift; // size为2的幂，shift = log2(size)
+	int32_t format; // 新建slab的格式，见enum rte_slab_format
+	int32_t coloring; // 是否对新建的slab着色
+	uint32_t color_next; // 下一个slab的颜色，在可用的颜色数内循环
 	int32_t offset; // 页中的空闲slab组成一个链表，在slab中便宜量为offset的地方中存放下一个slab的地址
 	uint64_t oo; // oo = order<<OO_SHIFT |slab_num（存在slab占用多个页的情况）
 	struct mem_cache_node local_node;
 	uint64_t min_partial;
+	uint64_t reserved; // rte_mem_cache_reserve()预留的slab个数，partial链表中至少保留这么多个slab
+	int32_t base_order; // calculate_order()得到的order，调优时order不低于此值
+	struct mem_cache_stat stat;
+	const struct rte_slub_mobility *mobility; // 为NULL时不整理本cache
 };
 
 static inline void RTE_SLUB_BUG(const char *name, int line)
@@ -40,6 +133,22 @@ static inline void RTE_SLUB_BUG(const char *name, int line)
 	assert(0);
 }
 
+static inline unsigned long rte_oo_make(int order, unsigned long size)
+{
+	unsigned long x = {(order<<RTE_OO_SHIFT) + (RTE_PAGE_SIZE<<order)/size};
+	return x;
+}
+
+static inline int rte_oo_order(unsigned long x)
+{
+	return x>>RTE_OO_SHIFT;
+}
+
+static inline int rte_oo_objects(unsigned long x)
+{
+	return x & RTE_OO_MASK;
+}
+
 /* Only for x86_64, from arch/x86/include/asm/bitops.h */
 static inline unsigned int rte_fls(unsigned int x)
 {
@@ -51,7 +160,27 @@ static inline unsigned int rte_fls(unsigned int x)
 
 
 int rte_slub_system_init(struct rte_mem_cache *array, int cache_num);
-void * __rte_slub_alloc(uint32_t size);
+int rte_slub_system_attach(struct rte_mem_cache *array, int cache_num);
+void * __rte_slub_alloc(uint32_t size, unsigned int flags);
 void __rte_slub_free(void *ptr);
+void rte_slub_tune(void);
+void rte_slub_shrink(void);
+void rte_slub_maintain(void (*barrier)(void));
+struct rte_mem_cache *rte_slub_caches(int *cache_num);
+int rte_slub_set_mobility(uint32_t size, const struct rte_slub_mobility *ops);
+int rte_slub_set_format(uint32_t size, int format);
+int rte_slub_set_coloring(uint32_t size, int on);
+
+/* 启动时的预热配置: 为size所在规格的cache预留objects个Obj */
+struct rte_mem_reserve{
+	uint32_t size;
+	uint32_t objects;
+};
+
+int rte_mem_cache_reserve(uint32_t size, uint32_t n_objects);
+int rte_mem_cache_prime(uint32_t size, int cores);
+int rte_slub_prewarm(const struct rte_mem_reserve *res, int nr, int cores);
+int rte_slub_defrag(uint32_t size);
+int rte_slub_latency(struct rte_mem_cache *s, int path, struct rte_lat_hist *hist);
 
 #endif
@@ -1,5 +1,9 @@
 #ifndef __RTE_SPINLOCK_H__
 #define __RTE_SPINLOCK_H__
+#include <assert.h>
+#include <stdio.h>
+#include "rte_types.h"
+
 typedef struct{
 	volatile int value;
 }rte_spinlock_t;
@@ -63,4 +67,194 @@ static inline int __rte_spinlock_trylock__(rte_spinlock_t *sl)
 #define rte_spinlock_lock(lock) __rte_spinlock_lock__(lock)
 #define rte_spinlock_trylock(lock) __rte_spinlock_trylock__(lock)
 
+static inline void rte_pause(void)
+{
+	__asm__ __volatile__ ("pause" ::: "memory");
+}
+
+/*
+ * Ticket lock: 按申请顺序获得锁，保证公平。
+ * 等待者只读owner，释放时只有owner所在的cache line被修改。
+ * */
+typedef struct{
+	union{
+		volatile uint32_t value;
+		struct{
+			volatile uint16_t owner; // 当前持有锁的票号
+			volatile uint16_t next; // 下一个可领取的票号
+		};
+	};
+}rte_ticketlock_t;
+
+static inline void rte_ticketlock_init(rte_ticketlock_t *tl)
+{
+	tl->value = 0;
+}
+
+static inline void rte_ticketlock_lock(rte_ticketlock_t *tl)
+{
+	uint16_t me = __atomic_fetch_add(&tl->next, 1, __ATOMIC_RELAXED);
+
+	while(__atomic_load_n(&tl->owner, __ATOMIC_ACQUIRE)!=me){
+		rte_pause();
+	}
+}
+
+static inline void rte_ticketlock_unlock(rte_ticketlock_t *tl)
+{
+	uint16_t i = __atomic_load_n(&tl->owner, __ATOMIC_RELAXED);
+	__atomic_store_n(&tl->owner, i+1, __ATOMIC_RELEASE);
+}
+
+static inline int rte_ticketlock_locked(rte_ticketlock_t *tl)
+{
+	rte_ticketlock_t t;
+	t.value = __atomic_load_n(&tl->value, __ATOMIC_ACQUIRE);
+	return (t.owner!=t.next);
+}
+
+/*
+ * Try to take the lock
+ * return:
+ * 	1: success; 0 otherwise.
+ * */
+static inline int rte_ticketlock_trylock(rte_ticketlock_t *tl)
+{
+	rte_ticketlock_t old, new;
+
+	old.value = __atomic_load_n(&tl->value, __ATOMIC_RELAXED);
+	if(old.owner!=old.next){
+		return 0;
+	}
+	new.value = old.value;
+	new.next++;
+	return __atomic_compare_exchange_n(&tl->value, (uint32_t *)&old.value, new.value, 0,
+									   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/*
+ * MCS lock: 等待者组成队列，每个等待者只在自己的节点上自旋，
+ * 锁被释放时只唤醒队首，避免所有Core争抢同一个cache line。
+ * 队列节点取自每个线程私有的节点数组，锁中记录持有者的节点，
+ * 因此lock/unlock的接口与rte_spinlock_t相同，且允许非嵌套顺序的解锁。
+ * */
+#define RTE_MCS_MAX_NODES 4 // 每个线程可同时持有(或等待)的MCS锁个数
+
+struct rte_mcs_node{
+	struct rte_mcs_node *volatile next;
+	volatile int locked;
+	int used;
+}__attribute__((aligned(64)));
+
+typedef struct{
+	struct rte_mcs_node *volatile tail; // 队尾节点, NULL表示锁空闲
+	struct rte_mcs_node *owner; // 持有者的节点，只有持有者读写
+}rte_mcslock_t;
+
+static __thread struct rte_mcs_node __rte_mcs_nodes[RTE_MCS_MAX_NODES] __attribute__((unused));
+
+static inline struct rte_mcs_node *__rte_mcs_node_get(void)
+{
+	int i;
+	for(i=0;i<RTE_MCS_MAX_NODES;i++){
+		if(!__rte_mcs_nodes[i].used){
+			__rte_mcs_nodes[i].used = 1;
+			__rte_mcs_nodes[i].next = NULL;
+			__rte_mcs_nodes[i].locked = 1;
+			return &__rte_mcs_nodes[i];
+		}
+	}
+	printf("MCS_BUG: too many nested locks.\n");
+	assert(0);
+	return NULL;
+}
+
+static inline void rte_mcslock_init(rte_mcslock_t *ml)
+{
+	ml->tail = NULL;
+	ml->owner = NULL;
+}
+
+static inline void rte_mcslock_lock(rte_mcslock_t *ml)
+{
+	struct rte_mcs_node *me = __rte_mcs_node_get();
+	struct rte_mcs_node *prev;
+
+	prev = __atomic_exchange_n(&ml->tail, me, __ATOMIC_ACQ_REL);
+	if(prev){
+		__atomic_store_n(&prev->next, me, __ATOMIC_RELEASE);
+		while(__atomic_load_n(&me->locked, __ATOMIC_ACQUIRE)){
+			rte_pause();
+		}
+	}
+	ml->owner = me;
+}
+
+static inline void rte_mcslock_unlock(rte_mcslock_t *ml)
+{
+	struct rte_mcs_node *me = ml->owner;
+	struct rte_mcs_node *next;
+
+	ml->owner = NULL;
+	next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE);
+	if(!next){
+		struct rte_mcs_node *expected = me;
+		if(__atomic_compare_exchange_n(&ml->tail, &expected, NULL, 0,
+									   __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+			me->used = 0;
+			return;
+		}
+		/* 有新的等待者正在入队，等待其链接到本节点之后 */
+		while(!(next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE))){
+			rte_pause();
+		}
+	}
+	__atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+	me->used = 0;
+}
+
+static inline int rte_mcslock_locked(rte_mcslock_t *ml)
+{
+	return (__atomic_load_n(&ml->tail, __ATOMIC_ACQUIRE)!=NULL);
+}
+
+static inline int rte_mcslock_trylock(rte_mcslock_t *ml)
+{
+	struct rte_mcs_node *me;
+	struct rte_mcs_node *expected = NULL;
+
+	if(__atomic_load_n(&ml->tail, __ATOMIC_RELAXED)){
+		return 0;
+	}
+	me = __rte_mcs_node_get();
+	if(__atomic_compare_exchange_n(&ml->tail, &expected, me, 0,
+								   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+		ml->owner = me;
+		return 1;
+	}
+	me->used = 0;
+	return 0;
+}
+
+/*
+ * 按锁的使用位置在编译时选择锁的实现，kind取值为:
+ * 	spinlock: test-and-set锁(默认)
+ * 	ticketlock: 公平的排队锁
+ * 	mcslock: 可扩展的队列锁
+ * 例如: make CFLAGS+="-DRTE_ZONE_LOCK=mcslock"
+ * */
+#define __RTE_LOCK_T(kind) rte_##kind##_t
+#define __rte_lock_init(kind, l) rte_##kind##_init(l)
+#define __rte_lock_lock(kind, l) rte_##kind##_lock(l)
+#define __rte_lock_unlock(kind, l) rte_##kind##_unlock(l)
+#define __rte_lock_trylock(kind, l) rte_##kind##_trylock(l)
+#define __rte_lock_locked(kind, l) rte_##kind##_locked(l)
+
+#define RTE_LOCK_T(kind) __RTE_LOCK_T(kind)
+#define rte_lock_init(kind, l) __rte_lock_init(kind, l)
+#define rte_lock_lock(kind, l) __rte_lock_lock(kind, l)
+#define rte_lock_unlock(kind, l) __rte_lock_unlock(kind, l)
+#define rte_lock_trylock(kind, l) __rte_lock_trylock(kind, l)
+#define rte_lock_locked(kind, l) __rte_lock_locked(kind, l)
+
 #endif
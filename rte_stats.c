@@ -0,0 +1,138 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rte_stats.h"
+
+static struct rte_stats *stats_shm;
+static char stats_name[64];
+static rte_spinlock_t stats_lock;
+
+/* 创建只读发布的共享内存段 /dev/shm/rte_memstat.<pid> */
+int rte_stats_init(void)
+{
+	int fd;
+	void *addr;
+
+	if(stats_shm){
+		return 0;
+	}
+	snprintf(stats_name, sizeof(stats_name), RTE_STATS_SHM_NAME, getpid());
+	fd = shm_open(stats_name, O_CREAT|O_RDWR|O_TRUNC, 0644);
+	if(fd<0){
+		return -1;
+	}
+	if(ftruncate(fd, sizeof(struct rte_stats))<0){
+		close(fd);
+		shm_unlink(stats_name);
+		return -1;
+	}
+	addr = mmap(NULL, sizeof(struct rte_stats), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(addr==MAP_FAILED){
+		shm_unlink(stats_name);
+		return -1;
+	}
+	memset(addr, 0, sizeof(struct rte_stats));
+	rte_spinlock_init(&stats_lock);
+	stats_shm = addr;
+	stats_shm->magic = RTE_STATS_MAGIC;
+	stats_shm->version = RTE_STATS_VERSION;
+	rte_stats_update();
+	return 0;
+}
+
+void rte_stats_exit(void)
+{
+	if(!stats_shm){
+		return;
+	}
+	munmap(stats_shm, sizeof(struct rte_stats));
+	shm_unlink(stats_name);
+	stats_shm = NULL;
+}
+
+/* 以下均为不加锁的读取，数值可能略有偏差，但不会影响分配器 */
+static void collect_zone(struct rte_stats_zone *z)
+{
+	struct rte_mem_zone *zone = rte_buddy_zone();
+	uint64_t usable = 0;
+	uint32_t i, j;
+
+	z->page_num = zone->page_num;
+	z->arena_num = zone->arena_num;
+	z->pressure = zone->pressure;
+	z->free_pages = 0;
+	for(i=0; i<NR_WMARK; i++){
+		z->watermark[i] = zone->watermark[i];
+	}
+	for(j=0; j<RTE_MAX_ORDER; j++){
+		z->nr_free[j] = 0;
+	}
+	for(i=0; i<zone->arena_num; i++){
+		z->free_pages += zone->arena[i].free_zero_num;
+		for(j=0; j<RTE_MAX_ORDER; j++){
+			z->nr_free[j] += zone->arena[i].free_area[j].nr_free;
+		}
+	}
+	/* 不可用空闲页比例: 不在最大块中的空闲页占所有空闲页的比例 */
+	usable = (uint64_t)z->nr_free[RTE_MAX_ORDER-1]<<(RTE_MAX_ORDER-1);
+	z->frag_index = z->free_pages ? (z->free_pages-usable)*1000/z->free_pages : 0;
+}
+
+static void collect_cache(struct rte_mem_cache *s, struct rte_stats_cache *st)
+{
+	uint64_t nr_alloc=0, nr_free=0;
+	uint64_t oo = s->oo;
+	int i;
+
+	for(i=0; i<RTE_MAX_CPU_NUM; i++){
+		nr_alloc += s->cpu_slab[i].nr_alloc;
+		nr_free += s->cpu_slab[i].nr_free;
+	}
+	st->size = s->size;
+	st->order = rte_oo_order(oo);
+	st->objects = rte_oo_objects(oo);
+	st->min_partial = s->min_partial;
+	st->nr_partial = s->local_node.nr_partial;
+	st->nr_slabs = s->stat.new_slab - s->stat.discard;
+	st->inuse = nr_alloc>nr_free ? nr_alloc-nr_free : 0;
+	st->alloc_slow = s->stat.alloc_slow;
+}
+
+/* 更新共享内存中的状态。同一时刻只有一个更新者 */
+void rte_stats_update(void)
+{
+	struct rte_mem_cache *caches;
+	struct timespec ts;
+	int cache_num;
+	int i;
+
+	if(!stats_shm||!rte_spinlock_trylock(&stats_lock)){
+		return;
+	}
+	caches = rte_slub_caches(&cache_num);
+	if(cache_num>RTE_SHM_CACHE_NUM){
+		cache_num = RTE_SHM_CACHE_NUM;
+	}
+
+	__atomic_store_n(&stats_shm->seq, stats_shm->seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	stats_shm->update_time = ts.tv_sec*1000000000UL + ts.tv_nsec;
+	collect_zone(&stats_shm->zone);
+	stats_shm->cache_num = cache_num;
+	for(i=0; i<cache_num; i++){
+		collect_cache(caches+i, &stats_shm->cache[i]);
+	}
+	for(i=0; i<RTE_TAG_NUM; i++){
+		rte_tag_stat(i, &stats_shm->tag[i]);
+	}
+
+	__atomic_store_n(&stats_shm->seq, stats_shm->seq+1, __ATOMIC_RELEASE);
+	rte_spinlock_unlock(&stats_lock);
+}
@@ -0,0 +1,73 @@
+#ifndef __RTE_STATS_H__
+#define __RTE_STATS_H__
+#include "rte_types.h"
+#include "rte_buddy.h"
+#include "rte_slub.h"
+#include "rte_tag.h"
+
+/*
+ * 发布到共享内存中的分配器状态，供rte_memstat等工具在进程外只读地查看。
+ * 由rte_stats_update()周期性地写入(后台维护线程会自动调用)，
+ * 读者通过seq实现的顺序锁无锁地读取，读取过程不影响分配器。
+ * */
+#define RTE_STATS_SHM_NAME "/rte_memstat.%d" // %d为进程号
+#define RTE_STATS_MAGIC 0x52544d53U
+#define RTE_STATS_VERSION 2
+
+struct rte_stats_cache{
+	uint32_t size;
+	uint32_t order;
+	uint32_t objects; // 每个slab中Obj的个数
+	uint32_t min_partial;
+	uint64_t nr_partial;
+	uint64_t nr_slabs; // 当前从Buddy系统分配的slab个数
+	uint64_t inuse; // 正在使用的Obj个数
+	uint64_t alloc_slow; // 累计进入慢速路径的次数
+};
+
+struct rte_stats_zone{
+	uint32_t page_num;
+	uint32_t free_pages;
+	uint32_t arena_num;
+	uint32_t pressure;
+	uint32_t watermark[NR_WMARK];
+	uint32_t nr_free[RTE_MAX_ORDER]; // 各order空闲块的个数(所有arena之和)
+	uint32_t frag_index; // 最大块的不可用空闲页比例，千分比
+};
+
+struct rte_stats{
+	uint32_t magic;
+	uint32_t version;
+	volatile uint64_t seq; // 奇数表示正在更新
+	uint64_t update_time; // 最近一次更新的时间(CLOCK_REALTIME，纳秒)
+	uint32_t cache_num;
+	struct rte_stats_zone zone;
+	struct rte_stats_cache cache[RTE_SHM_CACHE_NUM];
+	struct rte_tag_stat tag[RTE_TAG_NUM]; // 各tag的用量与限制，单位为页
+};
+
+int rte_stats_init(void);
+void rte_stats_update(void);
+void rte_stats_exit(void);
+
+/* 读者: 复制一份一致的快照，成功返回0 */
+static inline int rte_stats_read(const struct rte_stats *shm, struct rte_stats *snap)
+{
+	uint64_t seq;
+	int retry;
+
+	for(retry=0; retry<1000; retry++){
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if(seq&1){
+			continue;
+		}
+		__builtin_memcpy(snap, (const void *)shm, sizeof(*snap));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&shm->seq, __ATOMIC_RELAXED)==seq){
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif
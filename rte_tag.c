@@ -0,0 +1,143 @@
+#include "rte_buddy.h"
+#include "rte_tag.h"
+
+struct rte_tag{
+	volatile int64_t pages; // 已合并的全局计数
+	int64_t peak;
+	uint64_t soft_events;
+	uint64_t hard_fails;
+	uint64_t soft_limit;
+	uint64_t hard_limit;
+	int over_soft; // 已经超过soft_limit并记录过事件
+}__attribute__((aligned(64)));
+
+/* 每个Core的本地计数，维护线程等未设置Core序号的线程可能与Core 0共用，因此使用原子操作 */
+struct tag_cpu{
+	int64_t delta[RTE_TAG_NUM];
+}__attribute__((aligned(64)));
+
+static struct rte_tag tags[RTE_TAG_NUM];
+static struct tag_cpu tag_cpus[RTE_MAX_CPU_NUM];
+static rte_tag_cb_t soft_cb;
+static void *soft_cb_arg;
+static __thread int soft_notifying;
+__thread unsigned int rte_tag_soft_pending;
+
+__thread unsigned int rte_tag_current;
+
+static void tag_flush(unsigned int tag, int64_t *delta)
+{
+	struct rte_tag *t = tags + tag;
+	int64_t pages, peak;
+
+	pages = __atomic_add_fetch(&t->pages, __atomic_exchange_n(delta, 0, __ATOMIC_RELAXED),
+				__ATOMIC_RELAXED);
+	peak = __atomic_load_n(&t->peak, __ATOMIC_RELAXED);
+	while(pages>peak && !__atomic_compare_exchange_n(&t->peak, &peak, pages, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if(!t->soft_limit){
+		return;
+	}
+	if(pages>(int64_t)t->soft_limit){
+		if(!__atomic_exchange_n(&t->over_soft, 1, __ATOMIC_RELAXED)){
+			__atomic_fetch_add(&t->soft_events, 1, __ATOMIC_RELAXED);
+			/* 此时可能处于slab分配的中途，回调由本线程的rte_tag_soft_notify()执行 */
+			rte_tag_soft_pending |= 1U<<tag;
+		}
+	}else if(t->over_soft){
+		__atomic_store_n(&t->over_soft, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/* 只执行本线程记录的事件，回调中新记录的事件留到下一次分配返回前执行 */
+void __rte_tag_soft_notify(void)
+{
+	unsigned int pending, i;
+
+	if(soft_notifying){ // 回调中的分配不再嵌套执行回调
+		return;
+	}
+	soft_notifying = 1;
+	pending = rte_tag_soft_pending;
+	rte_tag_soft_pending = 0;
+	for(i=1; i<RTE_TAG_NUM; i++){
+		if((pending&(1U<<i)) && soft_cb){
+			soft_cb(soft_cb_arg, i, __atomic_load_n(&tags[i].pages, __ATOMIC_RELAXED));
+		}
+	}
+	soft_notifying = 0;
+}
+
+/* 分配nr_pages个页前调用。超过hard_limit时返回-1，分配应当失败 */
+int rte_tag_charge(unsigned int tag, unsigned int nr_pages)
+{
+	struct rte_tag *t = tags + tag;
+	int64_t *delta;
+
+	if(!tag){
+		return 0;
+	}
+	delta = &tag_cpus[rte_get_self_id()].delta[tag];
+	if(t->hard_limit &&
+	   t->pages + __atomic_load_n(delta, __ATOMIC_RELAXED) + nr_pages > (int64_t)t->hard_limit){
+		__atomic_fetch_add(&t->hard_fails, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	if(__atomic_add_fetch(delta, nr_pages, __ATOMIC_RELAXED)>=RTE_TAG_BATCH){
+		tag_flush(tag, delta);
+	}
+	return 0;
+}
+
+void rte_tag_uncharge(unsigned int tag, unsigned int nr_pages)
+{
+	int64_t *delta;
+
+	if(!tag){
+		return;
+	}
+	delta = &tag_cpus[rte_get_self_id()].delta[tag];
+	if(__atomic_sub_fetch(delta, nr_pages, __ATOMIC_RELAXED)<=-RTE_TAG_BATCH){
+		tag_flush(tag, delta);
+	}
+}
+
+/* 设置tag的限制，单位为字节，按页向下取整，0表示不限制 */
+int rte_tag_set_limit(unsigned int tag, uint64_t soft_bytes, uint64_t hard_bytes)
+{
+	if(!tag||tag>=RTE_TAG_NUM){
+		return -1;
+	}
+	tags[tag].soft_limit = soft_bytes>>RTE_PAGE_SHIFT;
+	tags[tag].hard_limit = hard_bytes>>RTE_PAGE_SHIFT;
+	tags[tag].over_soft = 0;
+	return 0;
+}
+
+void rte_tag_set_soft_cb(rte_tag_cb_t cb, void *arg)
+{
+	soft_cb_arg = arg;
+	soft_cb = cb;
+}
+
+/* pages为全局计数与各Core本地计数之和 */
+int rte_tag_stat(unsigned int tag, struct rte_tag_stat *st)
+{
+	struct rte_tag *t = tags + tag;
+	int i;
+
+	if(tag>=RTE_TAG_NUM){
+		return -1;
+	}
+	st->pages = t->pages;
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		st->pages += __atomic_load_n(&tag_cpus[i].delta[tag], __ATOMIC_RELAXED);
+	}
+	st->peak = t->peak>st->pages ? t->peak : st->pages;
+	st->soft_events = t->soft_events;
+	st->hard_fails = t->hard_fails;
+	st->soft_limit = t->soft_limit;
+	st->hard_limit = t->hard_limit;
+	return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef __RTE_TAG_H__
+#define __RTE_TAG_H__
+#include "rte_types.h"
+#include "rte_list.h"
+#include "rte_lcore.h"
+
+/*
+ * 按使用者(tag)统计内存并限制用量，多个子系统共用一个内存池时避免互相挤占。
+ * 每个线程有一个当前tag，Buddy系统分配页(包括Slub新建slab)时把页记到当前tag上，
+ * tag记录在首页的page->flags中，页被释放时从原tag中扣除，Obj的快速路径不受影响。
+ * 因此统计的粒度是页: slab中的Obj可能由其他tag的线程分配，slab记在新建它的tag上。
+ * 计数先累加在每个Core的本地计数中，超过RTE_TAG_BATCH页时才合并到全局计数，
+ * 限制的误差不超过RTE_TAG_BATCH*Core数个页。
+ * 	hard_limit: 超过后该tag的页分配失败
+ * 	soft_limit: 超过后分配仍然成功，但调用rte_tag_set_soft_cb()注册的回调，由使用者回收内存。
+ * 	            超过时只记下事件，回调推迟到rte_malloc/rte_get_pages等分配接口返回前，
+ * 	            由合并计数时发现超限的线程执行(不一定是该tag的线程，释放也会合并计数)，
+ * 	            此时不持有任何锁或Local slab，回调中可以分配和释放内存。
+ * 	            只做释放的线程记下的事件要等它下一次分配时才执行
+ * tag 0表示不统计，是线程的默认值
+ * */
+#define RTE_TAG_NUM 16
+#define RTE_TAG_BATCH 32
+
+struct rte_tag_stat{
+	int64_t pages; // 当前占用的页数
+	int64_t peak; // 合并到全局计数时观察到的最大值
+	uint64_t soft_events; // 超过soft_limit的次数
+	uint64_t hard_fails; // 因hard_limit而失败的分配次数
+	uint64_t soft_limit; // 页数，0表示不限制
+	uint64_t hard_limit;
+};
+
+typedef void (*rte_tag_cb_t)(void *arg, unsigned int tag, int64_t pages);
+
+/* 当前线程的tag */
+extern __thread unsigned int rte_tag_current;
+
+/* 设置当前线程的tag，返回原来的tag，tag无效时返回-1 */
+static inline int rte_tag_set(unsigned int tag)
+{
+	unsigned int old = rte_tag_current;
+
+	if(unlikely(tag>=RTE_TAG_NUM)){
+		return -1;
+	}
+	rte_tag_current = tag;
+	return old;
+}
+
+static inline unsigned int rte_tag_get(void)
+{
+	return rte_tag_current;
+}
+
+extern __thread unsigned int rte_tag_soft_pending; // 本线程待执行回调的tag位图
+void __rte_tag_soft_notify(void);
+
+/* 执行被推迟的soft_limit回调，由分配接口在返回前调用 */
+static inline void rte_tag_soft_notify(void)
+{
+	if(unlikely(rte_tag_soft_pending)){
+		__rte_tag_soft_notify();
+	}
+}
+
+int rte_tag_set_limit(unsigned int tag, uint64_t soft_bytes, uint64_t hard_bytes);
+void rte_tag_set_soft_cb(rte_tag_cb_t cb, void *arg);
+int rte_tag_stat(unsigned int tag, struct rte_tag_stat *st);
+int rte_tag_charge(unsigned int tag, unsigned int nr_pages);
+void rte_tag_uncharge(unsigned int tag, unsigned int nr_pages);
+
+#endif
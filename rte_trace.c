@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include "rte_spinlock.h"
+#include "rte_cycles.h"
+#include "rte_trace.h"
+
+/* 每个Core一个环形缓冲区，events[tail, head)尚未写入文件 */
+struct rte_trace_ring{
+	volatile uint32_t head; // 只由所在Core修改
+	volatile uint32_t tail; // 只由持有trace_lock的刷新者修改
+	uint64_t dropped;
+	struct rte_trace_event events[RTE_TRACE_RING_SIZE];
+}__attribute__((aligned(64)));
+
+volatile int rte_trace_enabled;
+static FILE *trace_file;
+static rte_spinlock_t trace_lock;
+static struct rte_trace_ring trace_rings[RTE_MAX_CPU_NUM];
+
+int rte_trace_start(const char *path)
+{
+	struct rte_trace_header hdr;
+	int i;
+
+	if(trace_file){
+		return -1;
+	}
+	trace_file = fopen(path, "wb");
+	if(NULL==trace_file){
+		return -1;
+	}
+	hdr.magic = RTE_TRACE_MAGIC;
+	hdr.version = RTE_TRACE_VERSION;
+	hdr.event_size = sizeof(struct rte_trace_event);
+	hdr.cpu_num = RTE_MAX_CPU_NUM;
+	hdr.start_tsc = rte_rdtsc();
+	if(fwrite(&hdr, sizeof(hdr), 1, trace_file)!=1){
+		fclose(trace_file);
+		trace_file = NULL;
+		return -1;
+	}
+	rte_spinlock_init(&trace_lock);
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		trace_rings[i].head = 0;
+		trace_rings[i].tail = 0;
+		trace_rings[i].dropped = 0;
+	}
+	__atomic_store_n(&rte_trace_enabled, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int trace_flush_ring(struct rte_trace_ring *r)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = r->tail;
+	uint32_t idx, nr;
+
+	while(tail!=head){
+		idx = tail & (RTE_TRACE_RING_SIZE-1);
+		nr = head - tail;
+		if(nr>RTE_TRACE_RING_SIZE-idx){ // 回绕时分两次写
+			nr = RTE_TRACE_RING_SIZE-idx;
+		}
+		if(fwrite(r->events+idx, sizeof(struct rte_trace_event), nr, trace_file)!=nr){
+			return -1;
+		}
+		tail += nr;
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+/* 把各Core缓冲区中的事件写入文件。已有其他线程在刷新时直接返回 */
+int rte_trace_flush(void)
+{
+	int i, ret=0;
+
+	if(!trace_file||!rte_spinlock_trylock(&trace_lock)){
+		return 0;
+	}
+	if(trace_file){
+		for(i=0;i<RTE_MAX_CPU_NUM;i++){
+			ret |= trace_flush_ring(trace_rings+i);
+		}
+		fflush(trace_file);
+	}
+	rte_spinlock_unlock(&trace_lock);
+	return ret;
+}
+
+void rte_trace_stop(void)
+{
+	uint64_t dropped=0;
+	int i;
+
+	if(!trace_file){
+		return;
+	}
+	__atomic_store_n(&rte_trace_enabled, 0, __ATOMIC_RELEASE);
+	rte_spinlock_lock(&trace_lock);
+	for(i=0;i<RTE_MAX_CPU_NUM;i++){
+		trace_flush_ring(trace_rings+i);
+		dropped += trace_rings[i].dropped;
+	}
+	fclose(trace_file);
+	trace_file = NULL;
+	rte_spinlock_unlock(&trace_lock);
+	if(dropped){
+		printf("rte_trace: %lu events dropped.\n", dropped);
+	}
+}
+
+void __rte_trace_event(unsigned int type, void *addr, uint32_t size, unsigned int flags)
+{
+	int id = rte_get_self_id();
+	struct rte_trace_ring *r;
+	struct rte_trace_event *e;
+	uint32_t head;
+
+	if(unlikely(id<0||id>=RTE_MAX_CPU_NUM)){
+		return;
+	}
+	r = trace_rings + id;
+	head = r->head;
+	if(unlikely(head-__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)>=RTE_TRACE_RING_SIZE)){
+		rte_trace_flush();
+		if(head-__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)>=RTE_TRACE_RING_SIZE){
+			r->dropped++;
+			return;
+		}
+	}
+	e = r->events + (head & (RTE_TRACE_RING_SIZE-1));
+	e->tsc = rte_rdtsc();
+	e->addr = (uint64_t)(unsigned long)addr;
+	e->size = size;
+	e->core = id;
+	e->type = type;
+	e->flags = flags;
+	__atomic_store_n(&r->head, head+1, __ATOMIC_RELEASE);
+}
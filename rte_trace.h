@@ -0,0 +1,59 @@
+#ifndef __RTE_TRACE_H__
+#define __RTE_TRACE_H__
+#include "rte_types.h"
+#include "rte_list.h"
+#include "rte_lcore.h"
+
+/*
+ * 分配事件记录。rte_trace_start()打开记录文件后，rte_malloc/rte_free/rte_get_pages/rte_free_pages
+ * (以及对应的_exact接口)的每次调用都写入所在Core的环形缓冲区(单生产者单消费者，不加锁)，
+ * rte_trace_flush()把各环形缓冲区中的事件追加到文件中，维护线程会周期性地调用它；
+ * 缓冲区满时由生产者尝试刷新一次，仍然满则丢弃事件并计数。
+ * 文件格式: 一个struct rte_trace_header，后面是若干struct rte_trace_event，
+ * 不同Core的事件在文件中交错，按tsc排序即可得到全局顺序。rte_replay可重放记录的文件
+ * */
+#define RTE_TRACE_MAGIC 0x52545452 // "RTTR"
+#define RTE_TRACE_VERSION 1
+#define RTE_TRACE_RING_SIZE 4096 // 每个Core的环形缓冲区中的事件个数，必须是2的幂
+
+enum rte_trace_type{
+	RTE_TRACE_MALLOC, // size为请求的字节数
+	RTE_TRACE_FREE,
+	RTE_TRACE_GET_PAGES, // size为order
+	RTE_TRACE_FREE_PAGES,
+	RTE_TRACE_GET_PAGES_EXACT, // size为页数
+	RTE_TRACE_FREE_PAGES_EXACT,
+};
+
+struct rte_trace_header{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t cpu_num;
+	uint64_t start_tsc;
+};
+
+struct rte_trace_event{
+	uint64_t tsc;
+	uint64_t addr; // 分配得到或要释放的地址，重放时用于配对分配与释放
+	uint32_t size;
+	uint16_t core;
+	uint8_t type;
+	uint8_t flags; // RTE_GFP_*
+};
+
+extern volatile int rte_trace_enabled;
+
+int rte_trace_start(const char *path);
+void rte_trace_stop(void);
+int rte_trace_flush(void);
+void __rte_trace_event(unsigned int type, void *addr, uint32_t size, unsigned int flags);
+
+static inline void rte_trace_event(unsigned int type, void *addr, uint32_t size, unsigned int flags)
+{
+	if(unlikely(rte_trace_enabled)){
+		__rte_trace_event(type, addr, size, flags);
+	}
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "rte_uring.h"
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	int ret;
+
+	do{
+		ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+	}while(ret<0&&errno==EINTR);
+	return ret;
+}
+
+int rte_uring_init(struct rte_uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if(ring->fd<0){
+		return -1;
+	}
+	ring->sq_entries = p.sq_entries;
+	ring->cq_entries = p.cq_entries;
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if(p.features&IORING_FEAT_SINGLE_MMAP){ // SQ和CQ在同一个映射中
+		if(ring->cq_ring_size>ring->sq_ring_size){
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	sq = mmap(NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			ring->fd, IORING_OFF_SQ_RING);
+	if(sq==MAP_FAILED){
+		goto err;
+	}
+	ring->sq_ring = sq;
+	if(p.features&IORING_FEAT_SINGLE_MMAP){
+		cq = sq;
+	}else{
+		cq = mmap(NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+				ring->fd, IORING_OFF_CQ_RING);
+		if(cq==MAP_FAILED){
+			goto err;
+		}
+	}
+	ring->cq_ring = cq;
+	ring->sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes==MAP_FAILED){
+		ring->sqes = NULL;
+		goto err;
+	}
+
+	ring->sq_head = (uint32_t *)((char *)sq + p.sq_off.head);
+	ring->sq_tail = (uint32_t *)((char *)sq + p.sq_off.tail);
+	ring->sq_mask = (uint32_t *)((char *)sq + p.sq_off.ring_mask);
+	ring->sq_array = (uint32_t *)((char *)sq + p.sq_off.array);
+	ring->cq_head = (uint32_t *)((char *)cq + p.cq_off.head);
+	ring->cq_tail = (uint32_t *)((char *)cq + p.cq_off.tail);
+	ring->cq_mask = (uint32_t *)((char *)cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+	ring->sq_local = ring->sq_submitted = *ring->sq_tail;
+	return 0;
+err:
+	rte_uring_exit(ring);
+	return -1;
+}
+
+void rte_uring_exit(struct rte_uring *ring)
+{
+	if(ring->sqes){
+		munmap(ring->sqes, ring->sq_entries*sizeof(struct io_uring_sqe));
+	}
+	if(ring->cq_ring&&ring->cq_ring!=ring->sq_ring){
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if(ring->sq_ring){
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if(ring->fd>=0){
+		close(ring->fd); // 关闭时内核同时注销固定缓冲区
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+/*
+ * 把zone注册为固定缓冲区，zone为NULL时使用当前进程的Buddy zone。
+ * 注册前应提交并收割完已有的I/O
+ * */
+int rte_uring_register(struct rte_uring *ring, struct rte_mem_zone *zone)
+{
+	struct iovec *iov;
+	unsigned long addr;
+	unsigned int i, n;
+	int ret;
+
+	if(NULL==zone){
+		zone = rte_buddy_zone();
+	}
+	if(NULL==zone||zone->end_addr<=zone->start_addr||ring->buf_num){
+		return -1;
+	}
+	n = (zone->end_addr - zone->start_addr + RTE_URING_BUF_SIZE - 1)>>RTE_URING_BUF_SHIFT;
+	iov = malloc(n*sizeof(struct iovec));
+	if(NULL==iov){
+		return -1;
+	}
+	for(i=0, addr=zone->start_addr; i<n; i++, addr+=RTE_URING_BUF_SIZE){
+		iov[i].iov_base = (void *)addr;
+		iov[i].iov_len = zone->end_addr - addr < RTE_URING_BUF_SIZE ?
+			zone->end_addr - addr : RTE_URING_BUF_SIZE;
+	}
+	ret = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, n);
+	free(iov);
+	if(ret<0){
+		return -1;
+	}
+	ring->buf_start = zone->start_addr;
+	ring->buf_end = zone->end_addr;
+	ring->buf_num = n;
+	return 0;
+}
+
+void rte_uring_unregister(struct rte_uring *ring)
+{
+	if(!ring->buf_num){
+		return;
+	}
+	syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+	ring->buf_start = ring->buf_end = 0;
+	ring->buf_num = 0;
+}
+
+/* 缓冲区在已注册的范围内时使用fixed操作，SQ已满时返回-1 */
+static int uring_prep(struct rte_uring *ring, int op, int op_fixed, int fd, const void *buf,
+		uint32_t len, uint64_t offset, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned long buf_off;
+	unsigned int index, idx;
+
+	if(ring->sq_local - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)>=ring->sq_entries){
+		return -1;
+	}
+	idx = ring->sq_local&*ring->sq_mask;
+	sqe = ring->sqes + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = len;
+	sqe->user_data = user_data;
+	if(!rte_uring_buf(ring, buf, len, &index, &buf_off)){
+		sqe->opcode = op_fixed;
+		sqe->buf_index = index; // 内核按addr在该缓冲区中定位，buf_off只用于检查
+		ring->nr_fixed++;
+	}else{
+		sqe->opcode = op;
+		ring->nr_plain++;
+	}
+	ring->sq_array[idx] = idx;
+	ring->sq_local++;
+	__atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int rte_uring_prep_read(struct rte_uring *ring, int fd, void *buf, uint32_t len,
+		uint64_t offset, uint64_t user_data)
+{
+	return uring_prep(ring, IORING_OP_READ, IORING_OP_READ_FIXED, fd, buf, len, offset, user_data);
+}
+
+int rte_uring_prep_write(struct rte_uring *ring, int fd, const void *buf, uint32_t len,
+		uint64_t offset, uint64_t user_data)
+{
+	return uring_prep(ring, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, fd, buf, len, offset, user_data);
+}
+
+/* 提交已准备的sqe并等待至少wait_nr个完成，返回提交的个数 */
+int rte_uring_submit(struct rte_uring *ring, unsigned int wait_nr)
+{
+	unsigned int to_submit = ring->sq_local - ring->sq_submitted;
+	int ret;
+
+	if(!to_submit&&!wait_nr){
+		return 0;
+	}
+	ret = uring_enter(ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+	if(ret<0){
+		return -1;
+	}
+	ring->sq_submitted += ret;
+	return ret;
+}
+
+/* 取一个完成事件，res为操作的返回值(负的errno)。没有完成的事件时返回0 */
+int rte_uring_peek(struct rte_uring *ring, uint64_t *user_data, int *res)
+{
+	struct io_uring_cqe *cqe;
+	uint32_t head = *ring->cq_head;
+
+	if(head==__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+		return 0;
+	}
+	cqe = ring->cqes + (head&*ring->cq_mask);
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ring->cq_head, head+1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* 同rte_uring_peek，没有完成的事件时提交剩余的sqe并阻塞等待 */
+int rte_uring_wait(struct rte_uring *ring, uint64_t *user_data, int *res)
+{
+	while(!rte_uring_peek(ring, user_data, res)){
+		if(rte_uring_submit(ring, 1)<0){
+			return -1;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef __RTE_URING_H__
+#define __RTE_URING_H__
+#include <linux/io_uring.h>
+#include "rte_types.h"
+#include "rte_buddy.h"
+
+/*
+ * 用io_uring对内存池中的内存做文件I/O，直接使用系统调用，不依赖liburing。
+ * rte_uring_register()把Buddy zone的地址范围[start_addr, end_addr)注册为固定缓冲区，
+ * 内核只在注册时pin一次页，之后的READ_FIXED/WRITE_FIXED不再对每次I/O做get_user_pages。
+ * 内核限制每个固定缓冲区不超过1GB，zone按RTE_URING_BUF_SHIFT切成等长的块依次注册，
+ * 任意rte_malloc/rte_get_pages得到的地址到(buf_index, offset)的映射只需一次减法和移位。
+ * 跨越块边界的I/O不能使用固定缓冲区(Buddy分配的页块不会跨越块边界)，
+ * rte_uring_prep_read/write对这种情况以及不在zone中的缓冲区自动改用普通的READ/WRITE。
+ * 一个rte_uring只能由一个线程提交和收割，多个Core各自创建自己的rte_uring。
+ * 注册会把zone的全部页锁定在内存中，非root用户受RLIMIT_MEMLOCK限制
+ * */
+#define RTE_URING_BUF_SHIFT 30
+#define RTE_URING_BUF_SIZE (1UL<<RTE_URING_BUF_SHIFT)
+
+struct rte_uring{
+	int fd;
+	unsigned int sq_entries;
+	unsigned int cq_entries;
+	uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+	uint32_t *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	uint32_t sq_local; // 已准备的sqe，sq_local-sq_submitted个尚未提交给内核
+	uint32_t sq_submitted;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	unsigned long buf_start, buf_end; // 已注册的范围，未注册时都为0
+	unsigned int buf_num;
+	uint64_t nr_fixed; // 使用固定缓冲区的I/O个数
+	uint64_t nr_plain;
+};
+
+/* 地址到固定缓冲区的映射，[buf, buf+len)不在已注册的某一个块中时返回-1 */
+static inline int rte_uring_buf(const struct rte_uring *ring, const void *buf, size_t len,
+		unsigned int *index, unsigned long *offset)
+{
+	unsigned long size = ring->buf_end - ring->buf_start;
+	unsigned long addr = (unsigned long)buf - ring->buf_start;
+
+	if(unlikely(addr>=size||len>size-addr)){
+		return -1;
+	}
+	if(unlikely((addr^(addr+(len?len-1:0)))>>RTE_URING_BUF_SHIFT)){
+		return -1;
+	}
+	*index = addr>>RTE_URING_BUF_SHIFT;
+	*offset = addr&(RTE_URING_BUF_SIZE-1);
+	return 0;
+}
+
+int rte_uring_init(struct rte_uring *ring, unsigned int entries);
+void rte_uring_exit(struct rte_uring *ring);
+int rte_uring_register(struct rte_uring *ring, struct rte_mem_zone *zone);
+void rte_uring_unregister(struct rte_uring *ring);
+int rte_uring_prep_read(struct rte_uring *ring, int fd, void *buf, uint32_t len,
+		uint64_t offset, uint64_t user_data);
+int rte_uring_prep_write(struct rte_uring *ring, int fd, const void *buf, uint32_t len,
+		uint64_t offset, uint64_t user_data);
+int rte_uring_submit(struct rte_uring *ring, unsigned int wait_nr);
+int rte_uring_peek(struct rte_uring *ring, uint64_t *user_data, int *res);
+int rte_uring_wait(struct rte_uring *ring, uint64_t *user_data, int *res);
+
+#endif